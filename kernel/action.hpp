@@ -4,7 +4,8 @@
 #include <lily/types.h>
 #include <lily/action.h>
 #include "kstring.hpp"
-#include "shared_ptr.hpp"
+#include "intrusive_ptr.hpp"
+#include "slab_allocator.hpp"
 
 class automaton;
 class buffer;
@@ -45,6 +46,20 @@ struct paction {
     description (d)
   { }
 
+  // Allocated from a slab cache.
+  static inline void*
+  operator new (size_t size)
+  {
+    kassert (size == sizeof (paction));
+    return slab_allocator<paction>::allocate (1);
+  }
+
+  static inline void
+  operator delete (void* ptr)
+  {
+    slab_allocator<paction>::deallocate (static_cast<paction*> (ptr), 1);
+  }
+
 private:
   paction (const paction&);
   paction& operator= (const paction&);
@@ -52,7 +67,7 @@ private:
 
 // Complete action.
 struct caction {
-  shared_ptr< ::automaton> automaton;
+  intrusive_ptr< ::automaton> automaton;
   const paction* action;
   int parameter;
 
@@ -62,7 +77,7 @@ struct caction {
     parameter (0)
   { }
 
-  caction (const shared_ptr< ::automaton>& a,
+  caction (const intrusive_ptr< ::automaton>& a,
 	   const paction* act,
 	   int p) :
     automaton (a),
@@ -1,6 +1,7 @@
 #include "automaton.hpp"
 #include "scheduler.hpp"
 #include "elf.hpp"
+#include "prelinked.hpp"
 
 aid_t automaton::current_aid_ = 0;
 automaton::aid_to_automaton_map_type automaton::aid_to_automaton_map_;
@@ -10,11 +11,16 @@ automaton::bid_to_binding_map_type automaton::bid_to_binding_map_;
 
 automaton::mapped_areas_type automaton::all_mapped_areas_;
 bitset<65536> automaton::reserved_ports_;
+intrusive_ptr<buffer> automaton::null_buffer_;
+
+automaton::reclaim_queue_type automaton::reclaim_queue_;
+
+elf_image::cache_type elf_image::cache_;
 
 // automaton::log_event_map_type automaton::log_event_map_;
 
 pair<int, lily_error_t>
-automaton::schedule (const shared_ptr<automaton>& ths,
+automaton::schedule (const intrusive_ptr<automaton>& ths,
 		     ano_t action_number,
 		     int parameter)
 {
@@ -45,7 +51,7 @@ automaton::schedule (const shared_ptr<automaton>& ths,
 
 // The automaton would like to no longer exist.
 void
-automaton::exit (const shared_ptr<automaton>& ths,
+automaton::exit (const intrusive_ptr<automaton>& ths,
 		 int code)
 {
   kassert (ths.get () == this);
@@ -64,83 +70,247 @@ automaton::exit (const shared_ptr<automaton>& ths,
   The dynamic resources are associated with a scoped object so that all dynamic resources are freed when an error is encountered.
   This is similiar to an auto pointer in the STL or scroped locking.
 
-  The basic procedure implemented by the function is to map the text of the automaton, parse it, unmap it, and then install it if successful.
+  The basic procedure implemented by the function is to map the text of the automaton, parse it into an image, unmap it, instantiate the image, and then install it if successful.
+  Images are cached so creating another automaton from the same text skips mapping and parsing.
   Installing is the process where global data structures are updated.
   Context (2) acquires the id_lock_ before invoking this function for thread safety.
 */
 
-pair<shared_ptr<automaton>, lily_error_t>
+pair<intrusive_ptr<automaton>, lily_error_t>
 automaton::create_automaton (bool privileged,
-			     const shared_ptr<buffer>& text,
+			     const intrusive_ptr<buffer>& text,
 			     size_t text_size)
 {
   // If the parent exists, we enter with the id_mutex_ locked and the parent's mod_mutex_ locked.
 
-  // Create the automaton.
-  shared_ptr<automaton> child = shared_ptr<automaton> (new automaton ());
-
-  // First, we want to map the text of the automaton in the kernel's address space.
-
   // Synchronize the buffer so the frames listed in the buffer are correct.
   // We must do this before switching to the kernel.
   text->sync (0, text->size ());
 
-  // If the text buffer is not mapped in the current page directory, there are no problems.
-  // If the text buffer is mapped, we have three options:
-  // 1.  Copy the buffer.
-  // 2.  Unmap the buffer and then map it back at its original location.
-  // 3.  Save the location of the buffer and temporarily override it.
-  // Option 3 has the least overhead so that's what we'll do.
-  logical_address_t const begin = text->begin ();
-  logical_address_t const end = text->end ();
-  text->override (0, 0);
-
-  // Switch to the kernel page directory.
-  physical_address_t original_directory = vm::switch_to_directory (vm::get_kernel_page_directory_physical_address ());
+  intrusive_ptr<elf_image> image = elf_image::find (*text, text_size);
+  const bool cached = image.get () != 0;
 
-  // Map the text of the initial automaton just after low memory.
-  const logical_address_t text_begin = INITIAL_LOGICAL_LIMIT - KERNEL_VIRTUAL_BASE;
-  const logical_address_t text_end = text_begin + text_size;
-  text->map_begin (text_begin);
+  if (!cached) {
+    image = intrusive_ptr<elf_image> (new elf_image (*text, text_size));
 
-  // Parse the file.
-  int parse_result = elf::parse (child, text_begin, text_end);
+    // First, we want to map the text of the automaton in the kernel's address space.
 
-  if (parse_result == 0) {
-    // Generate an id and insert into the aid to automaton map.
-    aid_t child_aid = current_aid_;
-    while (aid_to_automaton_map_.find (child_aid) != aid_to_automaton_map_.end ()) {
-      child_aid = max (child_aid + 1, 0); // Handles overflow.
+    // If the text buffer is not mapped in the current page directory, there are no problems.
+    // If the text buffer is mapped, we have three options:
+    // 1.  Copy the buffer.
+    // 2.  Unmap the buffer and then map it back at its original location.
+    // 3.  Save the location of the buffer and temporarily override it.
+    // Option 3 has the least overhead so that's what we'll do.
+    logical_address_t const begin = text->begin ();
+    logical_address_t const end = text->end ();
+    text->override (0, 0);
+    
+    // Switch to the kernel page directory.
+    physical_address_t original_directory = vm::switch_to_directory (vm::get_kernel_page_directory_physical_address ());
+    
+    // Map the text of the initial automaton just after low memory.
+    const logical_address_t text_begin = INITIAL_LOGICAL_LIMIT - KERNEL_VIRTUAL_BASE;
+    const logical_address_t text_end = text_begin + text_size;
+    text->map_begin (text_begin);
+    
+    // Parse the file.
+    // Pre-linked images only need to be validated.  ELF files are the fallback.
+    int parse_result;
+    if (prelinked::is_prelinked (text_begin, text_end)) {
+      parse_result = prelinked::parse (*image, text_begin, text_end);
+    }
+    else {
+      parse_result = elf::parse (*image, text_begin, text_end);
     }
-    current_aid_ = max (child_aid + 1, 0);
     
-    aid_to_automaton_map_.insert (make_pair (child_aid, child));
+    // Unmap the text.
+    text->unmap ();
     
-    child->aid_ = child_aid;
-    child->privileged_ = privileged;
+    // Switch back.
+    vm::switch_to_directory (original_directory);
     
-    // Add to the scheduler.
-    scheduler::add_automaton (child);
+    text->override (begin, end);
+
+    if (parse_result != 0) {
+      return make_pair (intrusive_ptr<automaton> (), LILY_ERROR_INVAL);
+    }
+  }
+
+  // Create the automaton.
+  intrusive_ptr<automaton> child = intrusive_ptr<automaton> (new automaton ());
+  if (child->page_directory == 0) {
+    return make_pair (intrusive_ptr<automaton> (), LILY_ERROR_NOMEM);
   }
+  child->image_ = image;
 
-  // Unmap the text.
-  text->unmap ();
+  int parse_result = elf::instantiate (child, *image);
 
-  // Switch back.
-  vm::switch_to_directory (original_directory);
+  if (parse_result == 0) {
+    install (child, privileged);
 
-  text->override (begin, end);
+    if (!cached) {
+      elf_image::insert (image);
+    }
+  }
 
   if (parse_result == 0) {
     return make_pair (child, LILY_ERROR_SUCCESS);
   }
   else {
-    return make_pair (shared_ptr<automaton> (), LILY_ERROR_INVAL);
+    return make_pair (intrusive_ptr<automaton> (), LILY_ERROR_INVAL);
+  }
+}
+
+/*
+  Cloning creates an automaton whose memory and actions are a copy of an existing automaton.
+  An automaton that has been created and initialized can serve as a template for automata that would otherwise require the same creation and initialization.
+
+  The clone shares the image and actions of the source.
+  Every page of the source that is not part of a buffer is shared copy-on-write.
+  Buffers are copied so the clone has the same buffer descriptors.
+  The clone has no bindings, subscriptions, I/O ports, or interrupts.
+  An automaton with memory mapped areas cannot be cloned because the areas are not managed by the frame manager.
+*/
+
+pair<intrusive_ptr<automaton>, lily_error_t>
+automaton::clone_automaton (bool privileged,
+			    const intrusive_ptr<automaton>& source)
+{
+  if (!source->enabled_ || !source->mapped_areas_.empty ()) {
+    // The source has been destroyed or maps memory.
+    return make_pair (intrusive_ptr<automaton> (), LILY_ERROR_INVAL);
+  }
+
+  intrusive_ptr<automaton> child = intrusive_ptr<automaton> (new automaton ());
+  if (child->page_directory == 0) {
+    return make_pair (intrusive_ptr<automaton> (), LILY_ERROR_NOMEM);
+  }
+  child->image_ = source->image_;
+
+  // Copy the actions.
+  for (ano_to_action_map_type::const_iterator pos = source->ano_to_action_map_.begin ();
+       pos != source->ano_to_action_map_.end ();
+       ++pos) {
+    child->add_action (pos->second);
+  }
+
+  // The pages of the source to map in the child.
+  typedef vector<pair<logical_address_t, pair<frame_t, vm::map_mode_t> > > page_list_type;
+  page_list_type pages;
+  // Buffers are mapped separately.
+  unordered_set<const vm_area_base*> mapped_buffers;
+
+  physical_address_t original_directory = vm::switch_to_directory (source->page_directory);
+
+  // Copy the buffers.
+  for (buffer_table_type::const_iterator pos = source->buffer_table_.begin ();
+       pos != source->buffer_table_.end ();
+       ++pos) {
+    if (pos->get () != 0) {
+      // Synchronizing makes the mapped pages copy-on-write.
+      (*pos)->sync (0, (*pos)->size ());
+      intrusive_ptr<buffer> b (new buffer (**pos));
+      if ((*pos)->begin () != 0) {
+	mapped_buffers.insert (pos->get ());
+	// Record the location so the buffer can be mapped in the child.
+	b->override ((*pos)->begin (), (*pos)->end ());
+      }
+      child->buffer_table_.push_back (b);
+    }
+    else {
+      child->buffer_table_.push_back (null_buffer_);
+    }
+  }
+  child->free_bds_ = source->free_bds_;
+  child->buffer_page_count_ = source->buffer_page_count_;
+  child->memory_quota_ = source->memory_quota_;
+  // The image pages mapped in the source are shared below.
+  child->image_page_count_ = source->image_page_count_;
+
+  // Share the pages.
+  for (vm_area_base* area = source->memory_map_.first (); area != 0; area = source->memory_map_.next (area)) {
+    if (mapped_buffers.find (area) != mapped_buffers.end ()) {
+      continue;
+    }
+
+    vm_area_base* a = new vm_area_base (area->begin (), area->end ());
+    if (area == source->heap_area_) {
+      child->heap_area_ = a;
+    }
+    else if (area == source->stack_area_) {
+      child->stack_area_ = a;
+    }
+    else {
+      child->insert_vm_area (a);
+    }
+
+    for (logical_address_t address = align_down (area->begin (), PAGE_SIZE);
+	 address < area->end ();
+	 address += PAGE_SIZE) {
+      if (!pages.empty () && pages.back ().first == address) {
+	// Areas may share a page.
+	continue;
+      }
+      frame_t frame;
+      vm::map_mode_t map_mode;
+      if (vm::share (address, frame, map_mode)) {
+	pages.push_back (make_pair (address, make_pair (frame, map_mode)));
+      }
+    }
+  }
+
+  child->insert_vm_area (child->heap_area_);
+  child->insert_vm_area (child->stack_area_);
+
+  vm::switch_to_directory (child->page_directory);
+
+  for (page_list_type::const_iterator pos = pages.begin ();
+       pos != pages.end ();
+       ++pos) {
+    vm::map (pos->first, pos->second.first, vm::USER, pos->second.second);
+  }
+
+  for (buffer_table_type::const_iterator pos = child->buffer_table_.begin ();
+       pos != child->buffer_table_.end ();
+       ++pos) {
+    if (pos->get () != 0 && (*pos)->begin () != 0) {
+      logical_address_t begin = (*pos)->begin ();
+      (*pos)->override (0, 0);
+      (*pos)->map_begin (begin);
+      child->insert_vm_area (pos->get ());
+    }
   }
+
+  vm::switch_to_directory (original_directory);
+
+  install (child, privileged);
+
+  return make_pair (child, LILY_ERROR_SUCCESS);
+}
+
+// Give a new automaton an id and make it visible to other automata and the scheduler.
+void
+automaton::install (const intrusive_ptr<automaton>& child,
+		    bool privileged)
+{
+  // Generate an id and insert into the aid to automaton map.
+  aid_t child_aid = current_aid_;
+  while (aid_to_automaton_map_.find (child_aid) != aid_to_automaton_map_.end ()) {
+    child_aid = max (child_aid + 1, 0); // Handles overflow.
+  }
+  current_aid_ = max (child_aid + 1, 0);
+  
+  aid_to_automaton_map_.insert (make_pair (child_aid, child));
+  
+  child->aid_ = child_aid;
+  child->privileged_ = privileged;
+  
+  // Add to the scheduler.
+  scheduler::add_automaton (child);
 }
 
 void
-automaton::destroy (const shared_ptr<automaton>& ths)
+automaton::destroy (const intrusive_ptr<automaton>& ths)
 {
   kassert (ths.get () == this);
   
@@ -163,8 +333,9 @@ automaton::destroy (const shared_ptr<automaton>& ths)
     memory_map_
     heap_area_
     stack_area_
-    current_bd_
-    bd_to_buffer_map_
+    buffer_table_
+    free_bds_
+    buffer_pool_
     bound_outputs_map_
     bound_inputs_map_
     owned_bindings_
@@ -190,8 +361,9 @@ automaton::destroy (const shared_ptr<automaton>& ths)
   // Leave memory_map_ for dtor.
   // Leave heap_area_ for dtor.
   // Leave stack_area_ for dtor.
-  // Leave current_bd_ for dtor.
-  // Leave bd_to_buffer_map_ for dtor.
+  // Leave buffer_table_ for dtor.
+  // Leave free_bds_ for dtor.
+  // Leave buffer_pool_ for dtor.
   
   for (bound_outputs_map_type::const_iterator pos1 = bound_outputs_map_.begin ();
        pos1 != bound_outputs_map_.end ();
@@ -223,9 +395,7 @@ automaton::destroy (const shared_ptr<automaton>& ths)
     mapped_areas_type::iterator pos3 = find (all_mapped_areas_.begin (), all_mapped_areas_.end (), *pos);
     kassert (pos3 != all_mapped_areas_.end ());
     all_mapped_areas_.erase (pos3);
-    memory_map_type::iterator pos2 = find (memory_map_.begin (), memory_map_.end (), *pos);
-    kassert (pos2 != memory_map_.end ());
-    memory_map_.erase (pos2);
+    memory_map_.erase (*pos);
     delete (*pos);
   }
   mapped_areas_.clear ();
@@ -245,72 +415,121 @@ automaton::destroy (const shared_ptr<automaton>& ths)
   irq_map_.clear ();
   
   scheduler::remove_automaton (ths);
+
+  // Leave the memory for the idle loop.
+  reclaim_queue_.push_back (ths);
 }
 
-// pair<bd_t, int>
-// buffer_copy (bd_t other,
-  // 	       size_t begin,
-  // 	       size_t end)
-  // {
-  //   if (begin > end) {
-  //     return make_pair (-1, LILY_SYSCALL_EINVAL);
-  //   }
+/*
+  Reclaiming the memory of an automaton is proportional to the size of the automaton.
+  To avoid delaying other automata, destroy () only disables the automaton and removes it from the system.
+  The idle loop then reclaims the memory in chunks of at most page_budget pages.
+  Returns true when all of the memory has been reclaimed.
+*/
 
-  //   bd_to_buffer_map_type::const_iterator bpos = bd_to_buffer_map_.find (other);
-  //   if (bpos == bd_to_buffer_map_.end ()) {
-  //     // Buffer does not exist.
-  //     return make_pair (-1, LILY_SYSCALL_EBDDNE);
-  //   }
+bool
+automaton::reclaim (size_t page_budget)
+{
+  kassert (!reclaimed_);
 
-  //   buffer* b = bpos->second;
-  //   if (end > b->size ()) {
-  //     // End is past end of buffer.
-  //     return make_pair (-1, LILY_SYSCALL_EINVAL);
-  //   }
+  if (page_directory == 0) {
+    // The page directory could not be created so there is nothing to reclaim.
+    reclaimed_ = true;
+    return true;
+  }
+
+  // We need to switch to this automaton's page directory to take apart the memory map.
+  // Either we are already using this automaton's memory map or we are using someone else's (including the kernel).
+  // If we were using our own, pretend we were using the kernel.
+  physical_address_t old_page_directory;
+  if (vm::get_directory () == page_directory) {
+    old_page_directory = vm::get_kernel_page_directory_physical_address ();
+  }
+  else {
+    old_page_directory = vm::switch_to_directory (page_directory);
+  }
+
+  while (page_budget != 0 && !buffer_table_.empty ()) {
+    intrusive_ptr<buffer> b = buffer_table_.back ();
+    buffer_table_.pop_back ();
+    if (b.get () != 0) {
+      // Remove from the memory map.
+      if (b->begin () != 0) {
+	remove_vm_area (b.get ());
+      }
+      const size_t cost = b->size () + 1;
+      page_budget = (cost < page_budget) ? page_budget - cost : 0;
+    }
+    // This removes the reference to the buffer.
+  }
+  // Nothing for free_bds_.
+  // The pooled buffers are empty and unmapped.
+  buffer_pool_.clear ();
 
-  //   // Generate an id.
-  //   bd_t bd = generate_bd ();
+  // Nothing for heap_area_.
+  // Nothing for stack_area_.
+
+  /*
+    The tricky part is returning all of the frames used by this automaton.
+    Let's start by reviewing the memory map of an automaton.
     
-  //   // Create the buffer and insert it into the map.
-  //   buffer* n = new buffer (*b, begin, end);
-  //   bd_to_buffer_map_.insert (make_pair (bd, n));
+    0-KERNEL_VIRTUAL_BASE		: Memory mapped I/O regions, text, data, heap, buffers, stack in roughly that order
+    KERNEL_VIRTUAL_BASE - PAGING_AREA : Kernel text and data
+    PAGING_AREA - end			: Page tables and page directory.
     
-  //   return make_pair (bd, LILY_SYSCALL_ESUCCESS);
-  // }
+    The frames occupied by memory mapped I/O regions are not managed by the frame manager, thus, we should ignore them.
+    Note that all of the mapped_areas were removed from memory_map_ in destroy ().
+    
+    Buffers need to be synchronized before they are destroyed due to copy-on-write semantics.
+    The preceding code destroys all of the buffers.
+    
+    Thus, we need to be concerned with (1) the text/data/heap/stack frames, (2) the kernel, and (3) the paging area.
+    First, we will remove (1).
+    Areas are removed in order so reclaim_address_ never moves backwards.
+  */
 
-  // pair<size_t, int>
-  // buffer_append (bd_t dst,
-  // 		 bd_t src,
-  // 		 size_t begin,
-  // 		 size_t end)
-  // {
-  //   if (begin > end) {
-  //     return make_pair (-1, LILY_SYSCALL_EINVAL);
-  //   }
+  while (page_budget != 0 && !memory_map_.empty ()) {
+    vm_area_base* area = memory_map_.first ();
+    reclaim_address_ = max (reclaim_address_, align_down (area->begin (), PAGE_SIZE));
+    for (; reclaim_address_ < area->end () && page_budget != 0; reclaim_address_ += PAGE_SIZE, --page_budget) {
+      // No error if not mapped.
+      // We need this because regions overlap and pages of the image are mapped on demand.
+      vm::unmap (reclaim_address_, true, false);
+    }
 
-  //   bd_to_buffer_map_type::const_iterator dst_pos = bd_to_buffer_map_.find (dst);
-  //   bd_to_buffer_map_type::const_iterator src_pos = bd_to_buffer_map_.find (src);
-  //   if (dst_pos == bd_to_buffer_map_.end () ||
-  // 	src_pos == bd_to_buffer_map_.end ()) {
-  //     // One of the buffers does not exist.
-  //     return make_pair (-1, LILY_SYSCALL_EBDDNE);
-  //   }
+    if (reclaim_address_ >= area->end ()) {
+      memory_map_.erase (area);
+      delete area;
+    }
+  }
 
-  //   buffer* d = dst_pos->second;
-  //   buffer* s = src_pos->second;
-  //   if (end > s->size ()) {
-  //     // Offset is past end of source.
-  //     return make_pair (-1, LILY_SYSCALL_EINVAL);
-  //   }
-    
-  //   if (d->begin () != 0) {
-  //     // The destination is mapped.
-  //     return make_pair (-1, LILY_SYSCALL_EMAPPED);
-  //   }
+  if (!buffer_table_.empty () || !memory_map_.empty ()) {
+    // Continue later.
+    vm::switch_to_directory (old_page_directory);
+    return false;
+  }
 
-  //   // Append.
-  //   return make_pair (d->append (*s, begin, end), LILY_SYSCALL_ESUCCESS);
-  // }
+  /* To remove (2) and (3) we scan the page directory for page tables that are present and decref the frame.
+     This works because all of these frames including the kernel are reference counted.
+     Large pages map memory mapped I/O regions and are skipped.
+  */
+  vm::page_directory* dir = vm::get_page_directory ();
+  for (page_table_idx_t idx = 0; idx != DIRECTORY_ENTRY_COUNT; ++idx) {
+    if (dir->entry[idx].present_ == vm::PRESENT && dir->entry[idx].page_size_ == vm::PAGE_SIZE_4K) {
+      frame_manager::decref (dir->entry[idx].frame ());
+    }
+  }
+  
+  /* Switch back to the old page directory. */
+  vm::switch_to_directory (old_page_directory);
+  
+  /* The page directories have a reference from when we allocated them.
+     Drop the reference count. */
+  vm::destroy_directory (page_directory);
+
+  reclaimed_ = true;
+  return true;
+}
 
   // int
   // buffer_assign (bd_t dest,
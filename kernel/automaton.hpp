@@ -19,9 +19,12 @@
 #include "gdt.hpp"
 #include "action.hpp"
 #include "buffer.hpp"
+#include "elf_image.hpp"
 #include "unordered_map.hpp"
 #include "unordered_set.hpp"
 #include "mapped_area.hpp"
+#include "vm_area_map.hpp"
+#include "deque.hpp"
 #include "lily/syscall.h"
 #include "io.hpp"
 #include "irq_handler.hpp"
@@ -30,14 +33,14 @@
 #include "bitset.hpp"
 #include "mutex.hpp"
 #include "lock.hpp"
-#include "shared_ptr.hpp"
+#include "intrusive_ptr.hpp"
 #include "boot_automaton.hpp"
 
 // The stack.
 static const logical_address_t STACK_END = KERNEL_VIRTUAL_BASE;
 static const logical_address_t STACK_BEGIN = STACK_END - PAGE_SIZE;
 
-class automaton {
+class automaton : public ref_counted {
 
   /**********************************************************************
    * STATIC VARIABLES                                                   *
@@ -52,7 +55,7 @@ private:
   static aid_t current_aid_;
 
   // Map from aid to automaton.
-  typedef unordered_map<aid_t, shared_ptr<automaton> > aid_to_automaton_map_type;
+  typedef unordered_map<aid_t, intrusive_ptr<automaton> > aid_to_automaton_map_type;
   static aid_to_automaton_map_type aid_to_automaton_map_;
 
   /*
@@ -80,7 +83,7 @@ private:
   static bid_t current_bid_;
 
   // Map from bid to binding.
-  typedef unordered_map<bid_t, shared_ptr<binding> > bid_to_binding_map_type;
+  typedef unordered_map<bid_t, intrusive_ptr<binding> > bid_to_binding_map_type;
   static bid_to_binding_map_type bid_to_binding_map_;
 
   /*
@@ -99,7 +102,7 @@ private:
    * SUBSCRIPTIONS
    */
   // // Automata subscribing to log events.
-  // typedef unordered_map<shared_ptr<automaton>, const paction*> log_event_map_type;
+  // typedef unordered_map<intrusive_ptr<automaton>, const paction*> log_event_map_type;
   // static log_event_map_type log_event_map_;
 
   /*
@@ -123,11 +126,20 @@ private:
    */
 
 public:
-  static pair<shared_ptr<automaton>, lily_error_t>
+  static pair<intrusive_ptr<automaton>, lily_error_t>
   create_automaton (bool privileged,
-		    const shared_ptr<buffer>& text,
+		    const intrusive_ptr<buffer>& text,
 		    size_t text_size);
 
+  static pair<intrusive_ptr<automaton>, lily_error_t>
+  clone_automaton (bool privileged,
+		   const intrusive_ptr<automaton>& source);
+
+private:
+  static void
+  install (const intrusive_ptr<automaton>& child,
+	   bool privileged);
+
   /*
    * EXECUTION
    */
@@ -142,7 +154,7 @@ public:
 
 private:
   static void
-  unbind (const shared_ptr<binding>& binding,
+  unbind (const intrusive_ptr<binding>& binding,
 	  bool remove_from_output,
 	  bool remove_from_input)
   {
@@ -155,7 +167,7 @@ private:
     
     // Unbind.
     if (remove_from_output) {
-      shared_ptr<automaton> output_automaton = binding->output_action.automaton;
+      intrusive_ptr<automaton> output_automaton = binding->output_action.automaton;
       bound_outputs_map_type::iterator pos = output_automaton->bound_outputs_map_.find (binding->output_action);
       kassert (pos != output_automaton->bound_outputs_map_.end ());
       size_t count = pos->second.erase (binding);
@@ -166,7 +178,7 @@ private:
     }
     
     if (remove_from_input) {
-      shared_ptr<automaton> input_automaton = binding->input_action.automaton;
+      intrusive_ptr<automaton> input_automaton = binding->input_action.automaton;
       bound_inputs_map_type::iterator pos = input_automaton->bound_inputs_map_.find (binding->input_action);
       kassert (pos != input_automaton->bound_inputs_map_.end ());
       size_t count = pos->second.erase (binding);
@@ -210,6 +222,8 @@ private:
    * DESCRIPTION
    */
 
+  // Image of the text.  The image owns the actions.
+  intrusive_ptr<elf_image> image_;
   // Map from action number to action.
   typedef unordered_map<ano_t, const paction* const> ano_to_action_map_type;
   ano_to_action_map_type ano_to_action_map_;
@@ -243,24 +257,60 @@ public:
   // Physical address that contains the automaton's page directory.
   physical_address_t const page_directory;
 private:
-  // Memory map. Consider using a set/map if insert/remove becomes too expensive.
-  typedef vector<vm_area_base*> memory_map_type;
-  memory_map_type memory_map_;
+  // Memory map.
+  vm_area_map memory_map_;
   // Heap area.
   vm_area_base* heap_area_;
   // Stack area.
   vm_area_base* stack_area_;
-  // Next buffer descriptor to allocate.
-  bd_t current_bd_;
-  // Map from bd_t to buffer*.
-  typedef unordered_map<bd_t, shared_ptr<buffer> > bd_to_buffer_map_type;
-  bd_to_buffer_map_type bd_to_buffer_map_;
+  // Copy-on-write faults.  A fault on the page after the last resolved page is sequential.
+  logical_address_t last_copy_on_write_page_;
+  size_t copy_on_write_fault_count_;
+  size_t copy_on_write_page_count_;
+  // Pages of the image that have been mapped.
+  size_t image_page_count_;
+  // Pages in buffers.  A page shared by buffers is counted in each.
+  size_t buffer_page_count_;
+  // Limit on the pages in the heap, stack, and buffers or MEMORY_QUOTA_NONE.
+  size_t memory_quota_;
+  // Buffer descriptors index the buffer table.
+  // Empty slots contain null_buffer_ and are listed in free_bds_ for reuse.
+  typedef vector<intrusive_ptr<buffer> > buffer_table_type;
+  buffer_table_type buffer_table_;
+  typedef vector<bd_t> free_bd_list_type;
+  free_bd_list_type free_bds_;
+  // Descriptors after the first two that were created for the executing input.
+  // An input declared with BEGIN_INPUT never sees them so they are destroyed for it.
+  typedef vector<bd_t> input_list_type;
+  input_list_type input_list_;
+  // Destroyed buffers that are recycled to avoid allocating in the kernel for every message.
+  static const size_t BUFFER_POOL_LIMIT = 16;
+  typedef vector<intrusive_ptr<buffer> > buffer_pool_type;
+  buffer_pool_type buffer_pool_;
+  // Returned by lookup_buffer for descriptors that do not refer to a buffer.
+  static intrusive_ptr<buffer> null_buffer_;
+
+  /*
+   * RECLAMATION
+   */
+
+  // Destroyed automata whose memory has not been reclaimed.
+  typedef deque<intrusive_ptr<automaton> > reclaim_queue_type;
+  static reclaim_queue_type reclaim_queue_;
+  // Number of pages reclaimed at a time.
+  static const size_t RECLAIM_PAGES = 64;
+  // Below this many free frames, destroyed automata are reclaimed completely before the next action.
+  static const size_t RECLAIM_LOW_WATER = 1024;
+  // All memory has been reclaimed.
+  bool reclaimed_;
+  // The next address to unmap in the first area of the memory map.
+  logical_address_t reclaim_address_;
 
   /*
    * BINDING
    */
 
-  typedef unordered_set <shared_ptr<binding> > binding_set_type;
+  typedef unordered_set <intrusive_ptr<binding> > binding_set_type;
   // Bound outputs.
   typedef unordered_map <caction, binding_set_type, caction_hash> bound_outputs_map_type;
   bound_outputs_map_type bound_outputs_map_;
@@ -311,19 +361,13 @@ public:
 
 public:
   inline bool
-  add_action (action_type_t t,
-	      parameter_mode_t pm,
-	      const void* aep,
-	      ano_t an,
-	      const kstring& name,
-	      const kstring& description)
-  {
-    if (ano_to_action_map_.find (an) == ano_to_action_map_.end () &&
-	(name.size () == 1 || name_to_action_map_.find (name) == name_to_action_map_.end ())) {
-      paction* action = new paction (t, pm, aep, an, name, description);
-      ano_to_action_map_.insert (make_pair (an, action));
-      if (name.size () > 1) {
-	name_to_action_map_.insert (make_pair (name, action));
+  add_action (const paction* action)
+  {
+    if (ano_to_action_map_.find (action->action_number) == ano_to_action_map_.end () &&
+	(action->name.size () == 1 || name_to_action_map_.find (action->name) == name_to_action_map_.end ())) {
+      ano_to_action_map_.insert (make_pair (action->action_number, action));
+      if (action->name.size () > 1) {
+	name_to_action_map_.insert (make_pair (action->name, action));
       }
       regenerate_description_ = true;
       return true;
@@ -367,7 +411,7 @@ public:
       return make_pair (-1, LILY_ERROR_AIDDNE);
     }
 
-    shared_ptr<automaton> subject = pos->second;
+    intrusive_ptr<automaton> subject = pos->second;
 
     if (subject->regenerate_description_) {
       // Form a description of the actions.
@@ -428,14 +472,14 @@ public:
     }
 
     // Find the text buffer.
-    shared_ptr<buffer> text_buffer = lookup_buffer (text_bd);
+    intrusive_ptr<buffer> text_buffer = lookup_buffer (text_bd);
     if (text_buffer.get () == 0) {
       // Buffer does not exist.
       return make_pair (-1, LILY_ERROR_BDDNE);
     }
     
     // Create the automaton.
-    pair<shared_ptr<automaton>, lily_error_t> r = create_automaton (retain_privilege && privileged_, text_buffer, text_buffer->size () * PAGE_SIZE);
+    pair<intrusive_ptr<automaton>, lily_error_t> r = create_automaton (retain_privilege && privileged_, text_buffer, text_buffer->size () * PAGE_SIZE);
     
     if (r.first.get () != 0) {
       return make_pair (r.first->aid (), r.second);
@@ -444,12 +488,82 @@ public:
       return make_pair (-1, r.second);
     }
   }
+
+  inline pair<aid_t, lily_error_t>
+  clone (const paction* action,
+	 aid_t aid,
+	 bool retain_privilege)
+  {
+    if (action->type != SYSTEM) {
+      return make_pair (-1, LILY_ERROR_CONTEXT);
+    }
+
+    aid_to_automaton_map_type::const_iterator pos = aid_to_automaton_map_.find (aid);
+    if (pos == aid_to_automaton_map_.end ()) {
+      return make_pair (-1, LILY_ERROR_AIDDNE);
+    }
+
+    if (pos->second.get () == this) {
+      // An automaton cannot clone itself while executing.
+      return make_pair (-1, LILY_ERROR_INVAL);
+    }
+
+    // The clone receives a copy of the memory of the original so only a privileged automaton can clone another automaton.
+    if (!privileged_) {
+      return make_pair (-1, LILY_ERROR_PERMISSION);
+    }
+
+    // Clone the automaton.
+    pair<intrusive_ptr<automaton>, lily_error_t> r = clone_automaton (retain_privilege && privileged_ && pos->second->privileged_, pos->second);
+
+    if (r.first.get () != 0) {
+      return make_pair (r.first->aid (), r.second);
+    }
+    else {
+      return make_pair (-1, r.second);
+    }
+  }
   
 private:
   void
-  destroy (const shared_ptr<automaton>& ths);
+  destroy (const intrusive_ptr<automaton>& ths);
+
+  bool
+  reclaim (size_t page_budget);
 
 public:
+  // Reclaim part of the memory of a destroyed automaton.
+  // Returns true if there is more to reclaim.
+  static inline bool
+  reclaim_destroyed ()
+  {
+    if (reclaim_queue_.empty ()) {
+      return false;
+    }
+
+    if (reclaim_queue_.front ()->reclaim (RECLAIM_PAGES)) {
+      reclaim_queue_.pop_front ();
+    }
+
+    return !reclaim_queue_.empty ();
+  }
+
+  // Called by the scheduler before every action so that a system that is never idle still reclaims memory.
+  // Reclaims one chunk or, when frames are scarce, everything.
+  static inline void
+  reclaim_destroyed_before_action ()
+  {
+    if (frame_manager::free_count () < RECLAIM_LOW_WATER) {
+      while (!reclaim_queue_.empty ()) {
+	reclaim_queue_.front ()->reclaim (static_cast<size_t> (-1));
+	reclaim_queue_.pop_front ();
+      }
+    }
+    else {
+      reclaim_destroyed ();
+    }
+  }
+
   inline pair<int, lily_error_t>
   destroy (aid_t aid)
   {
@@ -458,7 +572,7 @@ public:
       return make_pair (-1, LILY_ERROR_AIDDNE);
     }
 
-    shared_ptr<automaton> child = pos->second;
+    intrusive_ptr<automaton> child = pos->second;
 
     child->destroy (child);
 
@@ -486,8 +600,7 @@ public:
   inline void
   execute (const paction& action,
 	   int parameter,
-	   const shared_ptr<buffer>& output_buffer_a_,
-	   const shared_ptr<buffer>& output_buffer_b_)
+	   const vector<intrusive_ptr<buffer> >& output_buffers)
   {
     // Only execute if enabled.
     if (enabled_) {
@@ -520,22 +633,35 @@ public:
       switch (action.type) {
       case INPUT:
 	{
-	  bd_t bda = -1;
-	  bd_t bdb = -1;
+	  // The list of buffer descriptors lives on the stack above the arguments.
+	  const size_t bdc = output_buffers.size ();
+	  stack_pointer -= bdc;
+	  bd_t* bdv = reinterpret_cast<bd_t*> (stack_pointer);
 	  
-	  if (output_buffer_a_.get () != 0) {
-	    // Copy the buffer to the input automaton.
-	    bda = buffer_create (output_buffer_a_);
+	  input_list_.clear ();
+	  bd_t* bdp = bdv;
+	  for (vector<intrusive_ptr<buffer> >::const_iterator pos = output_buffers.begin ();
+	       pos != output_buffers.end ();
+	       ++pos, ++bdp) {
+	    if (pos->get () != 0) {
+	      // Copy the buffer to the input automaton.
+	      *bdp = buffer_create (*pos);
+	      if (bdp - bdv >= 2) {
+		input_list_.push_back (*bdp);
+	      }
+	    }
+	    else {
+	      *bdp = -1;
+	    }
 	  }
 	  
-	  if (output_buffer_b_.get () != 0) {
-	    // Copy the buffer to the input automaton.
-	    bdb = buffer_create (output_buffer_b_);
-	  }
+	  // Push the list.
+	  *--stack_pointer = bdc;
+	  *--stack_pointer = reinterpret_cast<uint32_t> (bdv);
 	  
-	  // Push the buffers.
-	  *--stack_pointer = bdb;
-	  *--stack_pointer = bda;
+	  // Push the first two buffers for inputs that only expect two.
+	  *--stack_pointer = (bdc > 1) ? bdv[1] : -1;
+	  *--stack_pointer = (bdc > 0) ? bdv[0] : -1;
 	}
 	break;
       case OUTPUT:
@@ -592,13 +718,13 @@ public:
   }
 
   pair<int, lily_error_t>
-  schedule (const shared_ptr<automaton>& ths,
+  schedule (const intrusive_ptr<automaton>& ths,
 	    ano_t action_number,
 	    int parameter);
 
   // The automaton would like to no longer exist.
   void
-  exit (const shared_ptr<automaton>& ths,
+  exit (const intrusive_ptr<automaton>& ths,
 	int code);
 
   inline void
@@ -623,16 +749,81 @@ public:
    * MEMORY MAP AND BUFFERS
    */
 
-private:
-  struct compare_vm_area {
-    inline bool
-    operator () (const vm_area_base* const x,
-		 const vm_area_base* const y) const
-    {
-      return x->begin () < y->begin ();
+public:
+  // Record a copy-on-write fault on the page at address.
+  // Returns true if the fault continues a sequential run of faults.
+  inline bool
+  copy_on_write_fault (logical_address_t address)
+  {
+    ++copy_on_write_fault_count_;
+    return address == last_copy_on_write_page_ + PAGE_SIZE;
+  }
+
+  // Record that the pages [begin, end) were resolved by a copy-on-write fault.
+  inline void
+  copy_on_write_resolved (logical_address_t begin,
+			  logical_address_t end)
+  {
+    copy_on_write_page_count_ += (end - begin) / PAGE_SIZE;
+    last_copy_on_write_page_ = end - PAGE_SIZE;
+  }
+
+  // Returns true if page_count pages beyond the faulting page can be resolved.
+  // The faulting page must be resolved regardless but resolving more pages is optional so it respects the quota and the free frames.
+  inline bool
+  can_fault_around (size_t page_count) const
+  {
+    return can_charge (page_count, true);
+  }
+
+  inline size_t
+  copy_on_write_fault_count () const
+  {
+    return copy_on_write_fault_count_;
+  }
+
+  inline size_t
+  copy_on_write_page_count () const
+  {
+    return copy_on_write_page_count_;
+  }
+
+  // Return the end of the area containing address or 0 if address is not in an area.
+  inline logical_address_t
+  area_end (logical_address_t address) const
+  {
+    const vm_area_base* area = memory_map_.find (address);
+    return area != 0 ? area->end () : 0;
+  }
+
+  // Map the page of the image containing address if it is not present.
+  // Returns false if the address is not part of the image.
+  inline bool
+  map_image_page (logical_address_t address)
+  {
+    kassert (page_directory == vm::get_directory ());
+
+    frame_t frame;
+    vm::map_mode_t map_mode;
+    if (image_.get () == 0 || !image_->lookup (address, frame, map_mode)) {
+      return false;
     }
-  };
 
+    const logical_address_t page = align_down (address, PAGE_SIZE);
+    if (!vm::is_present (page)) {
+      vm::map (page, frame, vm::USER, map_mode);
+      ++image_page_count_;
+    }
+    return true;
+  }
+
+  inline size_t
+  image_page_count () const
+  {
+    return image_page_count_;
+  }
+
+private:
   struct mapped_area_overlaps {
     physical_address_t physical_begin;
     physical_address_t physical_end;
@@ -666,50 +857,36 @@ private:
     }
   };
 
-  inline memory_map_type::const_iterator
-  find_address (logical_address_t address) const
+  // Insert a buffer into the buffer table and return its descriptor.
+  inline bd_t
+  insert_buffer (const intrusive_ptr<buffer>& b)
   {
-    vm_area_base k (address, address);
-    memory_map_type::const_iterator pos = upper_bound (memory_map_.begin (), memory_map_.end (), &k, compare_vm_area ());
-    // We know that area->begin () < (*pos)->begin ().
+    buffer_page_count_ += b->size ();
 
-    if (pos != memory_map_.begin ()) {
-      --pos;
-      if (address < (*pos)->end ()) {
-	return pos;
-      }
+    if (!free_bds_.empty ()) {
+      bd_t bd = free_bds_.back ();
+      free_bds_.pop_back ();
+      buffer_table_[bd] = b;
+      return bd;
     }
-    
-    return memory_map_.end ();
-  }
-
-  inline memory_map_type::iterator
-  find_address (logical_address_t address)
-  {
-    vm_area_base k (address, address);
-    memory_map_type::iterator pos = upper_bound (memory_map_.begin (), memory_map_.end (), &k, compare_vm_area ());
-    // We know that area->begin () < (*pos)->begin ().
-
-    if (pos != memory_map_.begin ()) {
-      --pos;
-      if (address < (*pos)->end ()) {
-	return pos;
-      }
+    else {
+      buffer_table_.push_back (b);
+      return buffer_table_.size () - 1;
     }
-    
-    return memory_map_.end ();
   }
 
-  inline bd_t
-  generate_bd ()
+  // Get an empty buffer from the pool or create one.
+  inline intrusive_ptr<buffer>
+  allocate_buffer ()
   {
-    // Generate an id.
-    bd_t bd = current_bd_;
-    while (bd_to_buffer_map_.find (bd) != bd_to_buffer_map_.end ()) {
-      bd = max (bd + 1, 0); // Handles overflow.
+    if (!buffer_pool_.empty ()) {
+      intrusive_ptr<buffer> b = buffer_pool_.back ();
+      buffer_pool_.pop_back ();
+      return b;
+    }
+    else {
+      return intrusive_ptr<buffer> (new buffer (0));
     }
-    current_bd_ = max (bd + 1, 0);
-    return bd;
   }
 
 public:
@@ -729,7 +906,7 @@ public:
       return false;
     }
 
-    heap_area_ = new vm_area_base (memory_map_.back ()->end (), memory_map_.back ()->end ());
+    heap_area_ = new vm_area_base (memory_map_.last ()->end (), memory_map_.last ()->end ());
     insert_vm_area (heap_area_);
 
     stack_area_ = new vm_area_base (STACK_BEGIN, STACK_END);
@@ -748,6 +925,7 @@ public:
     if (!is_aligned (heap_area_->begin (), PAGE_SIZE)) {
       // The heap is not page aligned.
       // We are going to remap it copy-on-write.
+      map_image_page (heap_area_->begin () - 1);
       vm::remap (heap_area_->begin (), vm::USER, vm::MAP_COPY_ON_WRITE);
     }
 
@@ -761,59 +939,30 @@ public:
   vm_area_is_free (logical_address_t begin,
   		   logical_address_t end)
   {
-    vm_area_base area (begin, end);
-    
-    // Find the location to insert.
-    memory_map_type::iterator pos = upper_bound (memory_map_.begin (), memory_map_.end (), &area, compare_vm_area ());
-    // We know that area->begin () < (*pos)->begin ().
-
-    // Ensure that the areas don't conflict.
-    if (pos != memory_map_.begin ()) {
-      memory_map_type::const_iterator prev = pos - 1;
-      if (area.begin () < (*prev)->end ()) {
-  	return false;
-      }
-    }
-
-    if (pos != memory_map_.end ()) {
-      if ((*pos)->begin () < area.end ()) {
-  	return false;
-      }
-    }
-    
-    return true;
+    return memory_map_.is_free (begin, end);
   }
 
   inline void
   insert_vm_area (vm_area_base* area)
   {
-    kassert (area != 0);
-    
-    // Find the location to insert.
-    memory_map_type::iterator pos = upper_bound (memory_map_.begin (), memory_map_.end (), area, compare_vm_area ());
-    memory_map_.insert (pos, area);
+    memory_map_.insert (area);
   }
   
   inline void
   remove_vm_area (vm_area_base* area)
   {
-    // TODO:  Use binary search.
-    memory_map_type::iterator pos = find (memory_map_.begin (), memory_map_.end (), area);
-    kassert (pos != memory_map_.end ());
-    memory_map_.erase (pos);
+    memory_map_.erase (area);
   }
 
-private:
   inline bool
   verify_span (const void* ptr,
   	       size_t size) const
   {
     const logical_address_t address = reinterpret_cast<logical_address_t> (ptr);
-    memory_map_type::const_iterator pos = find_address (address);
-    return pos != memory_map_.end () && (*pos)->begin () <= address && (address + size) <= (*pos)->end ();
+    const vm_area_base* area = memory_map_.find (address);
+    return area != 0 && (address + size) <= area->end ();
   }
 
-public:
   inline bool
   verify_stack (const void* ptr,
 		size_t size) const
@@ -824,6 +973,54 @@ public:
     return stack_area_->begin () <= address && (address + size) <= stack_area_->end ();
   }
 
+private:
+  // A page of the heap that shares a page with the image is not counted.
+  inline size_t
+  heap_page_count () const
+  {
+    return heap_area_ != 0 ? (align_up (heap_area_->end (), PAGE_SIZE) - align_up (heap_area_->begin (), PAGE_SIZE)) / PAGE_SIZE : 0;
+  }
+
+  inline size_t
+  stack_page_count () const
+  {
+    return stack_area_ != 0 ? (stack_area_->end () - stack_area_->begin ()) / PAGE_SIZE : 0;
+  }
+
+  // The heap, stack, and buffers are charged against the quota.
+  // Pages are charged when they are reserved, not when they are first written, because a write fault cannot fail cleanly.
+  inline size_t
+  charged_page_count () const
+  {
+    return heap_page_count () + stack_page_count () + buffer_page_count_;
+  }
+
+  // Returns true if the automaton can reserve page_count more pages.
+  // Pages that will need new frames must also fit in the frames that are free.
+  inline bool
+  can_charge (size_t page_count,
+	      bool new_frames) const
+  {
+    if (memory_quota_ != MEMORY_QUOTA_NONE) {
+      const size_t charged = charged_page_count ();
+      if (charged > memory_quota_ || page_count > memory_quota_ - charged) {
+	return false;
+      }
+    }
+
+    return !new_frames || page_count <= frame_manager::free_count ();
+  }
+
+  // The heap is keyed by its end in the memory map so it is removed while it changes.
+  inline void
+  set_heap_end (logical_address_t end)
+  {
+    memory_map_.erase (heap_area_);
+    heap_area_->set_end (end);
+    memory_map_.insert (heap_area_);
+  }
+
+public:
   inline pair<void*, lily_error_t>
   adjust_break (ptrdiff_t size)
   {
@@ -834,15 +1031,16 @@ public:
       logical_address_t new_end = old_end + size;
       
       if (size > 0) {
-	// Find the heap.
-	memory_map_type::const_iterator pos = find (memory_map_.begin (), memory_map_.end (), heap_area_);
-	kassert (pos != memory_map_.end ());
-	// Move to the next.
-	++pos;
-	kassert (pos != memory_map_.end ());
-	if (new_end <= (*pos)->begin ()) {
+	if (!can_charge ((align_up (new_end, PAGE_SIZE) - align_up (old_end, PAGE_SIZE)) / PAGE_SIZE, true)) {
+	  return make_pair ((void*)0, LILY_ERROR_NOMEM);
+	}
+
+	// Find the area after the heap.
+	const vm_area_base* next = memory_map_.next (heap_area_);
+	kassert (next != 0);
+	if (new_end <= next->begin ()) {
 	  // The allocation does not interfere with next area.  Success.
-	  heap_area_->set_end (new_end);
+	  set_heap_end (new_end);
 	  
 	  // Map the zero frame.
 	  for (logical_address_t address = align_up (old_end, PAGE_SIZE); address < new_end; address += PAGE_SIZE) {
@@ -861,7 +1059,7 @@ public:
 	  // Can't shrink beyond the beginning of the heap.
 	  new_end = heap_area_->begin ();
 	}
-	heap_area_->set_end (new_end);
+	set_heap_end (new_end);
 
 	// Unmap.
 	for (logical_address_t address = align_up (new_end, PAGE_SIZE); address < old_end; address += PAGE_SIZE) {
@@ -876,73 +1074,145 @@ public:
     }
   }
 
-  // TODO:  Limit the number and size of buffers.
+  inline pair<int, lily_error_t>
+  get_memory_stats (aid_t aid,
+		    memory_stats_t* stats)
+  {
+    if (!verify_span (stats, sizeof (memory_stats_t))) {
+      return make_pair (-1, LILY_ERROR_INVAL);
+    }
+
+    aid_to_automaton_map_type::const_iterator pos = aid_to_automaton_map_.find (aid);
+    if (pos == aid_to_automaton_map_.end ()) {
+      return make_pair (-1, LILY_ERROR_AIDDNE);
+    }
+
+    const intrusive_ptr<automaton>& subject = pos->second;
+
+    stats->heap = subject->heap_page_count ();
+    stats->stack = subject->stack_page_count ();
+    stats->buffers = subject->buffer_page_count_;
+    stats->image = subject->image_page_count_;
+    // Add one for the page directory.
+    stats->page_tables = vm::count_user_page_tables (subject->page_directory) + 1;
+    stats->quota = subject->memory_quota_;
+    stats->free = frame_manager::free_count ();
+    stats->copy_on_write_faults = subject->copy_on_write_fault_count ();
+    stats->copy_on_write_pages = subject->copy_on_write_page_count ();
+
+    return make_pair (0, LILY_ERROR_SUCCESS);
+  }
+
+  // A privileged automaton can set the quota of any automaton.
+  // Other automata can only lower their own quota.
+  // A quota below the current usage prevents growth but does not reclaim memory.
+  inline pair<int, lily_error_t>
+  set_memory_quota (aid_t aid,
+		    size_t page_count)
+  {
+    aid_to_automaton_map_type::const_iterator pos = aid_to_automaton_map_.find (aid);
+    if (pos == aid_to_automaton_map_.end ()) {
+      return make_pair (-1, LILY_ERROR_AIDDNE);
+    }
+
+    const intrusive_ptr<automaton>& subject = pos->second;
+
+    if (!privileged_ && (subject.get () != this || page_count > memory_quota_)) {
+      return make_pair (-1, LILY_ERROR_PERMISSION);
+    }
+
+    subject->memory_quota_ = page_count;
+
+    return make_pair (0, LILY_ERROR_SUCCESS);
+  }
 
   inline pair<bd_t, lily_error_t>
   buffer_create (size_t size)
   {
-    // Generate an id.
-    bd_t bd = generate_bd ();
-    
-    // Create the buffer and insert it into the map.
-    buffer* b = new buffer (size);
-    bd_to_buffer_map_.insert (make_pair (bd, b));
+    if (!can_charge (size, true)) {
+      return make_pair (-1, LILY_ERROR_NOMEM);
+    }
 
-    return make_pair (bd, LILY_ERROR_SUCCESS);
+    // Create the buffer and insert it into the table.
+    intrusive_ptr<buffer> b = allocate_buffer ();
+    b->resize (size);
+    return make_pair (insert_buffer (b), LILY_ERROR_SUCCESS);
   }
 
   inline pair<bd_t, lily_error_t>
   buffer_copy (bd_t other)
   {
-    
-    bd_to_buffer_map_type::const_iterator bpos = bd_to_buffer_map_.find (other);
-    if (bpos == bd_to_buffer_map_.end ()) {
+    intrusive_ptr<buffer> b = lookup_buffer (other);
+    if (b.get () == 0) {
       // Buffer does not exist.
       return make_pair (-1, LILY_ERROR_BDDNE);
     }
 
-    shared_ptr<buffer> b = bpos->second;
+    return buffer_copy (other, 0, b->size ());
+  }
 
-    // Generate an id.
-    bd_t bd = generate_bd ();
-    
-    // Create the buffer and insert it into the map.
-    buffer* n = new buffer (*b, 0, b->size ());
-    bd_to_buffer_map_.insert (make_pair (bd, n));
-    
-    return make_pair (bd, LILY_ERROR_SUCCESS);
+  // Create a new buffer from the pages [begin, end) of another buffer.
+  // The frames are shared copy-on-write so no data is copied.
+  inline pair<bd_t, lily_error_t>
+  buffer_copy (bd_t other,
+	       size_t begin,
+	       size_t end)
+  {
+    intrusive_ptr<buffer> b = lookup_buffer (other);
+    if (b.get () == 0) {
+      // Buffer does not exist.
+      return make_pair (-1, LILY_ERROR_BDDNE);
+    }
+
+    if (begin > end ||
+	end > b->size ()) {
+      // Bad range.
+      return make_pair (-1, LILY_ERROR_INVAL);
+    }
+
+    if (!can_charge (end - begin, false)) {
+      return make_pair (-1, LILY_ERROR_NOMEM);
+    }
+
+    // Create the buffer and insert it into the table.
+    intrusive_ptr<buffer> n = allocate_buffer ();
+    n->append (*b, begin, end);
+    return make_pair (insert_buffer (n), LILY_ERROR_SUCCESS);
   }
   
+  // Used for output/input copying.
+  // other should be synchronized before this call.
   inline bd_t
-  buffer_create (const shared_ptr<buffer>& other)
+  buffer_create (const intrusive_ptr<buffer>& other)
   {
-    // Generate an id.
-    bd_t bd = generate_bd ();
-    
-    // Create the buffer and insert it into the map.
-    shared_ptr<buffer> b = shared_ptr<buffer> (new buffer (*other));
-    bd_to_buffer_map_.insert (make_pair (bd, b));
-    
-    return bd;
+    // Create the buffer and insert it into the table.
+    intrusive_ptr<buffer> b = allocate_buffer ();
+    b->share (*other);
+    return insert_buffer (b);
   }
 
   inline pair<int, lily_error_t>
   buffer_resize (bd_t bd,
 		 size_t size)
   {
-    bd_to_buffer_map_type::const_iterator bpos = bd_to_buffer_map_.find (bd);
-    if (bpos == bd_to_buffer_map_.end ()) {
+    intrusive_ptr<buffer> b = lookup_buffer (bd);
+    if (b.get () == 0) {
       // Buffer does not exist.
       return make_pair (-1, LILY_ERROR_BDDNE);
     }
 
-    shared_ptr<buffer> b = bpos->second;
     if (b->begin () != 0) {
       // Buffer was mapped.
       return make_pair (-1, LILY_ERROR_INVAL);
     }
 
+    if (size > b->size () && !can_charge (size - b->size (), true)) {
+      return make_pair (-1, LILY_ERROR_NOMEM);
+    }
+
+    buffer_page_count_ -= b->size ();
     b->resize (size);
+    buffer_page_count_ += b->size ();
     return make_pair (0, LILY_ERROR_SUCCESS);
   }
 
@@ -950,24 +1220,49 @@ public:
   buffer_append (bd_t dst,
 		 bd_t src)
   {
-    bd_to_buffer_map_type::const_iterator dst_pos = bd_to_buffer_map_.find (dst);
-    bd_to_buffer_map_type::const_iterator src_pos = bd_to_buffer_map_.find (src);
-    if (dst_pos == bd_to_buffer_map_.end () ||
-	src_pos == bd_to_buffer_map_.end ()) {
+    intrusive_ptr<buffer> s = lookup_buffer (src);
+    if (s.get () == 0) {
+      // Buffer does not exist.
+      return make_pair (-1, LILY_ERROR_BDDNE);
+    }
+
+    return buffer_append (dst, src, 0, s->size ());
+  }
+
+  // Append the pages [begin, end) of src to dst.
+  // The frames are shared copy-on-write so no data is copied.
+  inline pair<size_t, lily_error_t>
+  buffer_append (bd_t dst,
+		 bd_t src,
+		 size_t begin,
+		 size_t end)
+  {
+    intrusive_ptr<buffer> d = lookup_buffer (dst);
+    intrusive_ptr<buffer> s = lookup_buffer (src);
+    if (d.get () == 0 ||
+	s.get () == 0) {
       // One of the buffers does not exist.
       return make_pair (-1, LILY_ERROR_BDDNE);
     }
 
-    shared_ptr<buffer> d = dst_pos->second;
-    shared_ptr<buffer> s = src_pos->second;
+    if (begin > end ||
+	end > s->size ()) {
+      // Bad range.
+      return make_pair (-1, LILY_ERROR_INVAL);
+    }
     
     if (d->begin () != 0) {
       // The destination is mapped.
       return make_pair (-1, LILY_ERROR_INVAL);
     }
 
+    if (!can_charge (end - begin, false)) {
+      return make_pair (-1, LILY_ERROR_NOMEM);
+    }
+
     // Append.
-    d->append (*s, 0, s->size ());
+    d->append (*s, begin, end);
+    buffer_page_count_ += end - begin;
     return make_pair (0, LILY_ERROR_SUCCESS);
   }
 
@@ -977,17 +1272,14 @@ public:
 		 size_t begin,
 		 size_t end)
   {
-    bd_to_buffer_map_type::const_iterator dest_pos = bd_to_buffer_map_.find (dest);
-    bd_to_buffer_map_type::const_iterator src_pos = bd_to_buffer_map_.find (src);
-    if (dest_pos == bd_to_buffer_map_.end () ||
-	src_pos == bd_to_buffer_map_.end ()) {
+    intrusive_ptr<buffer> dest_b = lookup_buffer (dest);
+    intrusive_ptr<buffer> src_b = lookup_buffer (src);
+    if (dest_b.get () == 0 ||
+	src_b.get () == 0) {
       // One of the buffers does not exist.
       return make_pair (-1, LILY_ERROR_BDDNE);
     }
 
-    shared_ptr<buffer> dest_b = dest_pos->second;
-    shared_ptr<buffer> src_b = src_pos->second;
-
     if (begin > end ||
 	end > src_b->size ()) {
       return make_pair (-1, LILY_ERROR_INVAL);
@@ -998,9 +1290,15 @@ public:
       return make_pair (-1, LILY_ERROR_INVAL);
     }
 
+    if (end - begin > dest_b->size () && !can_charge (end - begin - dest_b->size (), false)) {
+      return make_pair (-1, LILY_ERROR_NOMEM);
+    }
+
     // Truncate and append.
+    buffer_page_count_ -= dest_b->size ();
     dest_b->resize (0);
     dest_b->append (*src_b, begin, end);
+    buffer_page_count_ += end - begin;
 
     // Append.
     return make_pair (0, LILY_ERROR_SUCCESS);
@@ -1044,32 +1342,18 @@ public:
 
 private:
   inline void*
-  buffer_map (const shared_ptr<buffer>& b)
+  buffer_map (const intrusive_ptr<buffer>& b)
   {
     kassert (heap_area_ != 0);
     kassert (stack_area_ != 0);
     
-    // Find the heap.
-    memory_map_type::const_reverse_iterator heap_pos = memory_map_type::const_reverse_iterator (find (memory_map_.begin (), memory_map_.end (), heap_area_));
-    
-    kassert (heap_pos != memory_map_.rbegin ());
-    --heap_pos;
-    kassert (heap_pos != memory_map_.rend ());
-    
-    // Find the stack.
-    memory_map_type::reverse_iterator stack_pos = find (memory_map_.rbegin (), memory_map_.rend (), stack_area_);
-    kassert (stack_pos != memory_map_.rend ());
-    
-    // Find a hole and map.
-    for (; stack_pos != heap_pos; ++stack_pos) {
-      memory_map_type::reverse_iterator prev = stack_pos + 1;
-      size_t size = (*stack_pos)->begin () - (*prev)->end ();
-      if (size >= b->size () * PAGE_SIZE) {
-	b->map_end ((*stack_pos)->begin ());
-	memory_map_.insert (prev.base (), b.get ());
-	// Success.
-	return (void*)b->begin ();
-      }
+    // Find the highest hole between the heap and the stack.
+    vm_area_base* above = memory_map_.find_gap (b->size () * PAGE_SIZE, heap_area_->end (), stack_area_->begin ());
+    if (above != 0) {
+      b->map_end (above->begin ());
+      memory_map_.insert (b.get ());
+      // Success.
+      return (void*)b->begin ();
     }
     
     // Couldn't find a big enough hole.
@@ -1081,13 +1365,11 @@ public:
   inline pair<void*, lily_error_t>
   buffer_map (bd_t bd)
   {
-    bd_to_buffer_map_type::const_iterator bpos = bd_to_buffer_map_.find (bd);
-    if (bpos == bd_to_buffer_map_.end ()) {
+    intrusive_ptr<buffer> b = lookup_buffer (bd);
+    if (b.get () == 0) {
       // The buffer does not exist.
       return make_pair ((void*)0, LILY_ERROR_BDDNE);
     }
-
-    shared_ptr<buffer> b = bpos->second;
     
     if (b->size () == 0) {
       // The buffer is empty.
@@ -1112,7 +1394,7 @@ public:
 
 private:
   inline void
-  buffer_unmap (const shared_ptr<buffer>& b)
+  buffer_unmap (const intrusive_ptr<buffer>& b)
   {
     if (b->begin () != 0) {
       // Remove from the memory map.
@@ -1127,34 +1409,56 @@ public:
   inline pair<int, lily_error_t>
   buffer_unmap (bd_t bd)
   {
-    bd_to_buffer_map_type::iterator bpos = bd_to_buffer_map_.find (bd);
-    if (bpos == bd_to_buffer_map_.end ()) {
+    intrusive_ptr<buffer> b = lookup_buffer (bd);
+    if (b.get () == 0) {
       // The buffer does not exist.
       return make_pair (-1, LILY_ERROR_BDDNE);
     }
     
-    shared_ptr<buffer> b = bpos->second;
     buffer_unmap (b);
 
     return make_pair (0, LILY_ERROR_SUCCESS);
   }
 
+  // Destroy the descriptors after the first two that were delivered to the input that just finished.
+  // Called when the input finishes with two buffers, i.e., without naming them.
+  inline void
+  destroy_input_list ()
+  {
+    for (input_list_type::const_iterator pos = input_list_.begin ();
+	 pos != input_list_.end ();
+	 ++pos) {
+      buffer_destroy (*pos);
+    }
+    input_list_.clear ();
+  }
+
+  // The input that just finished named the buffers it wanted destroyed.
+  inline void
+  forget_input_list ()
+  {
+    input_list_.clear ();
+  }
+
   inline pair<int, lily_error_t>
   buffer_destroy (bd_t bd)
   {
-    bd_to_buffer_map_type::iterator bpos = bd_to_buffer_map_.find (bd);
-    if (bpos != bd_to_buffer_map_.end ()) {
-      shared_ptr<buffer> b = bpos->second;
-
-      if (b->begin () != 0) {
-	// Remove from the memory map.
-	remove_vm_area (b.get ());
-	// Buffer will be unmapped automatically when destroyed.
+    intrusive_ptr<buffer> b = lookup_buffer (bd);
+    if (b.get () != 0) {
+      // Remove from the memory map and unmap.
+      buffer_unmap (b);
+
+      // Empty the slot.
+      buffer_table_[bd] = null_buffer_;
+      free_bds_.push_back (bd);
+      buffer_page_count_ -= b->size ();
+
+      if (b.unique () && buffer_pool_.size () < BUFFER_POOL_LIMIT) {
+	// No one else is using the buffer so recycle it.
+	b->clear ();
+	buffer_pool_.push_back (b);
       }
 
-      // Remove from the bd map.
-      bd_to_buffer_map_.erase (bpos);
-
       return make_pair (0, LILY_ERROR_SUCCESS);
     }
     else {
@@ -1166,9 +1470,9 @@ public:
   inline pair<size_t, lily_error_t>
   buffer_size (bd_t bd)
   {
-    bd_to_buffer_map_type::const_iterator bpos = bd_to_buffer_map_.find (bd);
-    if (bpos != bd_to_buffer_map_.end ()) {
-      return make_pair (bpos->second->size (), LILY_ERROR_SUCCESS);
+    intrusive_ptr<buffer> b = lookup_buffer (bd);
+    if (b.get () != 0) {
+      return make_pair (b->size (), LILY_ERROR_SUCCESS);
     }
     else {
       // The buffer does not exist.
@@ -1176,15 +1480,15 @@ public:
     }
   }
 
-  inline shared_ptr<buffer>
+  // Returns a null pointer if the buffer does not exist.
+  inline intrusive_ptr<buffer>
   lookup_buffer (bd_t bd)
   {
-    bd_to_buffer_map_type::const_iterator bpos = bd_to_buffer_map_.find (bd);
-    if (bpos != bd_to_buffer_map_.end ()) {
-      return bpos->second;
+    if (bd >= 0 && static_cast<size_t> (bd) < buffer_table_.size ()) {
+      return buffer_table_[bd];
     }
     else {
-      return shared_ptr<buffer> ();
+      return null_buffer_;
     }
   }
 
@@ -1232,9 +1536,9 @@ public:
       return make_pair (-1, LILY_ERROR_IAIDDNE);
     }
     
-    shared_ptr<automaton> output_automaton = output_pos->second;
+    intrusive_ptr<automaton> output_automaton = output_pos->second;
     
-    shared_ptr<automaton> input_automaton = input_pos->second;
+    intrusive_ptr<automaton> input_automaton = input_pos->second;
     
     if (output_automaton == input_automaton) {
       // The output and input automata must be different.
@@ -1326,7 +1630,7 @@ public:
     current_bid_ = max (bid + 1, 0);
     
     // Create the binding.
-    shared_ptr<binding> b = shared_ptr<binding> (new binding (bid, oa, ia));
+    intrusive_ptr<binding> b = intrusive_ptr<binding> (new binding (bid, oa, ia));
     bid_to_binding_map_.insert (make_pair (bid, b));
     
     // Bind.
@@ -1352,7 +1656,7 @@ public:
       return make_pair (-1, LILY_ERROR_BIDDNE);
     }
     
-    shared_ptr<binding> binding = pos->second;
+    intrusive_ptr<binding> binding = pos->second;
     
     unbind (binding, true, true);
     
@@ -1425,9 +1729,20 @@ public:
     mapped_areas_.push_back (area);
     all_mapped_areas_.push_back (area);
 
+    // Use large pages where the logical and physical addresses allow it to reduce TLB pressure.
     physical_address_t pa = source_begin;
-    for (logical_address_t la = destination_begin; la != destination_end; la += PAGE_SIZE, pa += PAGE_SIZE) {
-      vm::map (la, physical_address_to_frame (pa), vm::USER, vm::MAP_READ_WRITE, false);
+    logical_address_t la = destination_begin;
+    while (la != destination_end) {
+      if (destination_end - la >= LARGE_PAGE_SIZE && is_aligned (pa, LARGE_PAGE_SIZE) && vm::can_map_large (la)) {
+	vm::map_large (la, pa, vm::USER);
+	la += LARGE_PAGE_SIZE;
+	pa += LARGE_PAGE_SIZE;
+      }
+      else {
+	vm::map (la, physical_address_to_frame (pa), vm::USER, vm::MAP_READ_WRITE, false);
+	la += PAGE_SIZE;
+	pa += PAGE_SIZE;
+      }
     }
 
     // Success.
@@ -1444,14 +1759,20 @@ public:
 
     mapped_area* area = *pos;
 
-    physical_address_t pa = area->physical_begin;
-    for (logical_address_t la = area->begin ();
-	 la != area->end ();
-	 la += PAGE_SIZE, pa += PAGE_SIZE) {
-      vm::unmap (la);
+    // The frames are not managed by the frame manager so they are not decremented.
+    logical_address_t la = area->begin ();
+    while (la != area->end ()) {
+      if (vm::is_large_page (la)) {
+	vm::unmap_large (la);
+	la += LARGE_PAGE_SIZE;
+      }
+      else {
+	vm::unmap (la, false);
+	la += PAGE_SIZE;
+      }
     }
 
-    mapped_areas_type::iterator pos2 = find (all_mapped_areas_.begin (), mapped_areas_.end (), area);
+    mapped_areas_type::iterator pos2 = find (all_mapped_areas_.begin (), all_mapped_areas_.end (), area);
     kassert (pos2 != all_mapped_areas_.end ());
     all_mapped_areas_.erase (pos2);
     mapped_areas_.erase (pos);
@@ -1567,7 +1888,7 @@ public:
   }
 
   inline pair<int, lily_error_t>
-  subscribe_irq (const shared_ptr<automaton>& ths,
+  subscribe_irq (const intrusive_ptr<automaton>& ths,
 		 int irq,
 		 ano_t action_number,
 		 int parameter)
@@ -1623,6 +1944,18 @@ public:
     return make_pair (0, LILY_ERROR_SUCCESS);
   }
 
+  // Print the allocation counts and bytes of the slab caches on the console.
+  inline pair<int, lily_error_t>
+  print_slab_statistics () const
+  {
+    if (!privileged_) {
+      return make_pair (-1, LILY_ERROR_PERMISSION);
+    }
+
+    slab_cache::print_statistics ();
+    return make_pair (0, LILY_ERROR_SUCCESS);
+  }
+
   inline pair<bd_t, lily_error_t>
   get_boot_data (void) const
   {
@@ -1658,7 +1991,7 @@ public:
     le.message_size = message_size;
     
     // Create a buffer for the description.
-    // shared_ptr<buffer> b (new buffer (page_count));
+    // intrusive_ptr<buffer> b (new buffer (page_count));
     // log_event_t* le = static_cast <log_event_t*> (buffer_map (b));
     // le->aid = aid_;
     // irq_handler::getmonotime (&le->time);
@@ -1680,7 +2013,7 @@ public:
     // for (log_event_map_type::const_iterator pos = log_event_map_.begin ();
     //      pos != log_event_map_.end ();
     //      ++pos) {
-    //   scheduler::schedule (caction (pos->first, pos->second, 0, b, shared_ptr<buffer> ()));
+    //   scheduler::schedule (caction (pos->first, pos->second, 0, b, intrusive_ptr<buffer> ()));
     // }
     
     return make_pair (0, LILY_ERROR_SUCCESS);
@@ -1694,30 +2027,22 @@ public:
     aid_ (-1),
     regenerate_description_ (false),
     enabled_ (true),
-    page_directory (frame_to_physical_address (frame_manager::alloc ())),
+    // Since the first argument is vm::SUPERVISOR, the automaton cannot access the paging area, i.e., manipulate virtual memory.
+    // If the second argument is vm::USER, the automaton gains access to kernel data.
+    // If the second argument is vm::SUPERVISOR, the automaton does not gain access to kernel data.
+    page_directory (vm::create_directory (vm::SUPERVISOR, vm::SUPERVISOR)),
     heap_area_ (0),
     stack_area_ (0),
-    current_bd_ (0),
+    last_copy_on_write_page_ (0),
+    copy_on_write_fault_count_ (0),
+    copy_on_write_page_count_ (0),
+    image_page_count_ (0),
+    buffer_page_count_ (0),
+    memory_quota_ (MEMORY_QUOTA_NONE),
+    reclaimed_ (false),
+    reclaim_address_ (0),
     privileged_ (false)
-  {
-    frame_t frame = physical_address_to_frame (page_directory);
-    kassert (frame != vm::zero_frame ());
-    // Map the page directory.
-    vm::map (vm::get_stub1 (), frame, vm::USER, vm::MAP_READ_WRITE);
-    vm::page_directory* pd = reinterpret_cast<vm::page_directory*> (vm::get_stub1 ());
-    // Initialize the page directory with a copy of the kernel.
-    // Since the second argument is vm::SUPERVISOR, the automaton cannot access the paging area, i.e., manipulate virtual memory.
-    // If the third argument is vm::USER, the automaton gains access to kernel data.
-    // If the third argument is vm::SUPERVISOR, the automaton does not gain access to kernel data.
-    new (pd) vm::page_directory (frame, vm::SUPERVISOR, vm::SUPERVISOR);
-    // Unmap.
-    vm::unmap (vm::get_stub1 ());
-
-    // At this point the page directory has a reference count of two.
-    // One reference came from allocation.
-    // The other reference came when we initialized the page directory (it refers to itself).
-    kassert (frame_manager::ref_count (frame) == 2);
-  }
+  { }
 
 private:
   // No copy.
@@ -1731,6 +2056,7 @@ public:
       
       aid_
       name_
+      image_
       ano_to_action_map_
       name_to_action_map_
       description_
@@ -1744,8 +2070,9 @@ public:
       memory_map_
       heap_area_
       stack_area_
-      current_bd_
-      bd_to_buffer_map_
+      buffer_table_
+      free_bds_
+      buffer_pool_
       bound_outputs_map_
       bound_inputs_map_
       owned_bindings_
@@ -1761,11 +2088,8 @@ public:
     kassert (aid_ == -1);
     
     // Nothing for name_.
-    for (ano_to_action_map_type::const_iterator pos = ano_to_action_map_.begin ();
-    	 pos != ano_to_action_map_.end ();
-    	 ++pos) {
-      delete pos->second;
-    }
+    // Nothing for image_.
+    // Nothing for ano_to_action_map_.  The image owns the actions.
     // Nothing for name_to_action_map_.
     // Nothing for description_.
     // Nothing for regenerate_description_.
@@ -1773,81 +2097,10 @@ public:
     // Nothing for init_buffer_a_.
     // Nothing for init_buffer_b_.
 
-    // We need to switch to this automaton's page directory to take apart the memory map.
-    // Either we are already using this automaton's memory map or we are using someone else's (including the kernel).
-    // If we were using our own, pretend we were using the kernel.
-    physical_address_t old_page_directory;
-    if (vm::get_directory () == page_directory) {
-      old_page_directory = vm::get_kernel_page_directory_physical_address ();
-    }
-    else {
-      old_page_directory = vm::switch_to_directory (page_directory);
-    }
-
-    // Nothing for current_bd_.
-    for (bd_to_buffer_map_type::const_iterator pos = bd_to_buffer_map_.begin ();
-	 pos != bd_to_buffer_map_.end ();
-	 ++pos) {
-      // Remove from the memory map.
-      if (pos->second->begin () != 0) {
-	remove_vm_area (pos->second.get ());
-      }
-    }
-    // This removes references to the buffers.
-    bd_to_buffer_map_.clear ();
-
-    // Nothing for heap_area_.
-    // Nothing for stack_area_.
-
-    /*
-      The tricky part is returning all of the frames used by this automaton.
-      Let's start by reviewing the memory map of an automaton.
-      
-      0-KERNEL_VIRTUAL_BASE		: Memory mapped I/O regions, text, data, heap, buffers, stack in roughly that order
-      KERNEL_VIRTUAL_BASE - PAGING_AREA : Kernel text and data
-      PAGING_AREA - end			: Page tables and page directory.
-
-      The frames occupied by memory mapped I/O regions are not managed by the frame manager, thus, we should ignore them.
-      Note that all of the mapped_areas were removed from memory_map_ in destroy ().
-
-      Buffers need to be synchronized before they are destroyed due to copy-on-write semantics.
-      The preceding code destroys all of the buffers.
-
-      Thus, we need to be concerned with (1) the text/data/heap/stack frames, (2) the kernel, and (3) the paging area.
-      First, we will remove (1).
-     */
-
-    for (memory_map_type::const_iterator pos = memory_map_.begin ();
-	 pos != memory_map_.end ();
-	 ++pos) {
-      for (logical_address_t la = (*pos)->begin ();
-	   la < (*pos)->end ();
-	   la += PAGE_SIZE) {
-	// No error if not mapped.
-	// We need this because regions overlap.
-	vm::unmap (la, true, false);
-      }
-
-      delete (*pos);
-    }
-
-    /* To remove (2) and (3) we scan the page directory for page tables that are present and decref the frame.
-       This works because all of these frames including the kernel are reference counted.
-     */
-    vm::page_directory* dir = vm::get_page_directory ();
-    for (page_table_idx_t idx = 0; idx != PAGE_ENTRY_COUNT; ++idx) {
-      if (dir->entry[idx].present_ == vm::PRESENT) {
-	frame_manager::decref (dir->entry[idx].frame_);
-      }
+    // Automata that were destroyed are normally reclaimed before this point.
+    if (!reclaimed_) {
+      reclaim (static_cast<size_t> (-1));
     }
-
-    /* Switch back to the old page directory. */
-    vm::switch_to_directory (old_page_directory);
-
-    /* The page directory has a reference from when we allocated it.
-       Drop the reference count. */
-    size_t count = frame_manager::decref (physical_address_to_frame (page_directory));
-    kassert (count == 0);
     
     kassert (bound_outputs_map_.empty ());
     kassert (bound_inputs_map_.empty ());
@@ -19,8 +19,9 @@
 #include "lily/types.h"
 #include "action.hpp"
 #include "unordered_map.hpp"
+#include "slab_allocator.hpp"
 
-struct binding {
+struct binding : public ref_counted {
   bid_t const bid;
   caction const output_action;
   caction const input_action;
@@ -38,6 +39,20 @@ struct binding {
     kassert (!enabled ());
   }
 
+  // Allocated from a slab cache.
+  static inline void*
+  operator new (size_t size)
+  {
+    kassert (size == sizeof (binding));
+    return slab_allocator<binding>::allocate (1);
+  }
+
+  static inline void
+  operator delete (void* ptr)
+  {
+    slab_allocator<binding>::deallocate (static_cast<binding*> (ptr), 1);
+  }
+
   bool
   enabled () const;
 
@@ -1,5 +1,5 @@
 #include "boot_automaton.hpp"
 #include "automaton.hpp"
 
-shared_ptr<automaton> boot_automaton;
+intrusive_ptr<automaton> boot_automaton;
 bd_t boot_data = -1;
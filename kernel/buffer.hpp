@@ -3,8 +3,8 @@
 
 #include "vm_area.hpp"
 #include "vector.hpp"
-
-// TODO:  Don't increment/decrement the zero frame.
+#include "slab_allocator.hpp"
+#include "intrusive_ptr.hpp"
 
 /*
   Buffer
@@ -38,13 +38,27 @@
   Thus, offsets and sizes are expressed in terms of frames.
 */
 
-class buffer : public vm_area_base {
+class buffer : public vm_area_base, public ref_counted {
 public:
+  // Allocated from a slab cache.
+  static inline void*
+  operator new (size_t size)
+  {
+    kassert (size == sizeof (buffer));
+    return slab_allocator<buffer>::allocate (1);
+  }
+
+  static inline void
+  operator delete (void* ptr)
+  {
+    slab_allocator<buffer>::deallocate (static_cast<buffer*> (ptr), 1);
+  }
+
   buffer (size_t size) :
     vm_area_base (0, 0),
     frame_list_ (size, vm::zero_frame ())
   {
-    frame_manager::incref (vm::zero_frame (), frame_list_.size ());
+    // The zero frame is not reference counted.
   }
   
   buffer (buffer& other,
@@ -63,6 +77,7 @@ public:
   // other should be synchronized before this call.
   buffer (const buffer& other) :
     vm_area_base (0, 0),
+    ref_counted (),
     frame_list_ (other.frame_list_)
   {
     for(frame_list_type::const_iterator pos = frame_list_.begin (); pos != frame_list_.end (); ++pos) {
@@ -87,10 +102,8 @@ public:
     begin_ = align_down (begin, PAGE_SIZE);
     end_ = begin_ + frame_list_.size () * PAGE_SIZE;
 
-    for (size_t idx = 0; idx != frame_list_.size (); ++idx) {
-      /* Do not increment the reference count. */
-      vm::map (begin_ + idx * PAGE_SIZE, frame_list_[idx], vm::USER, vm::MAP_COPY_ON_WRITE, false, vm::BUFFER);
-    }
+    /* Do not increment the reference count. */
+    vm::map_range (begin_, frame_list_.begin (), frame_list_.end (), vm::USER, vm::MAP_COPY_ON_WRITE, false, vm::BUFFER);
   }
 
   void
@@ -100,10 +113,8 @@ public:
       end_ = align_down (end, PAGE_SIZE);
       begin_ = end_ - frame_list_.size () * PAGE_SIZE;
       
-      for (size_t idx = 0; idx != frame_list_.size (); ++idx) {
-	/* Do not increment the reference count. */
-	vm::map (begin_ + idx * PAGE_SIZE, frame_list_[idx], vm::USER, vm::MAP_COPY_ON_WRITE, false, vm::BUFFER);
-      }
+      /* Do not increment the reference count. */
+      vm::map_range (begin_, frame_list_.begin (), frame_list_.end (), vm::USER, vm::MAP_COPY_ON_WRITE, false, vm::BUFFER);
     }
   }
 
@@ -113,10 +124,8 @@ public:
     if (begin_ != 0) {
       sync (0, frame_list_.size ());
 
-      for (size_t idx = 0; idx != frame_list_.size (); ++idx) {
-	/* Do not decrement the reference count. */
-	vm::unmap (begin_ + idx * PAGE_SIZE, false);
-      }
+      /* Do not decrement the reference count. */
+      vm::unmap_range (begin_, end_, false);
 
       begin_ = 0;
       end_ = 0;
@@ -153,8 +162,8 @@ public:
       }
     }
     else if (size > old_size) {
+      // The zero frame is not reference counted.
       frame_list_.resize (size, vm::zero_frame ());
-      frame_manager::incref (vm::zero_frame (), size - old_size);
     }
   }
 
@@ -182,19 +191,68 @@ public:
   {
     src.sync (src_begin, src_end);
 
-    for (size_t idx = 0; idx != (src_end - src_begin); ++idx) {
-      if (begin_ != 0) {
-	// Unmap.
-	vm::unmap (begin_ + (dst_begin + idx) * PAGE_SIZE, false);
-      }
+    const size_t count = src_end - src_begin;
+
+    if (begin_ != 0) {
+      // Unmap.
+      vm::unmap_range (begin_ + dst_begin * PAGE_SIZE, begin_ + (dst_begin + count) * PAGE_SIZE, false);
+    }
+
+    for (size_t idx = 0; idx != count; ++idx) {
       frame_manager::decref (frame_list_[dst_begin + idx]);
       frame_list_[dst_begin + idx] = src.frame_list_[src_begin + idx];
       frame_manager::incref (frame_list_[dst_begin + idx]);
-      if (begin_ != 0) {
-	// Map.
-	vm::map (begin_ + (dst_begin + idx) * PAGE_SIZE, frame_list_[dst_begin + idx], vm::USER, vm::MAP_COPY_ON_WRITE, false, vm::BUFFER);
+    }
+
+    if (begin_ != 0) {
+      // Map.
+      vm::map_range (begin_ + dst_begin * PAGE_SIZE, frame_list_.begin () + dst_begin, frame_list_.begin () + dst_begin + count, vm::USER, vm::MAP_COPY_ON_WRITE, false, vm::BUFFER);
+    }
+  }
+
+  // Share the frames of other.
+  // Used for output/input copying.
+  // other should be synchronized before this call.
+  void
+  share (const buffer& other)
+  {
+    // Cannot be mapped.
+    kassert (begin_ == 0);
+    size_t old_size = frame_list_.size ();
+    frame_list_.insert (frame_list_.end (), other.frame_list_.begin (), other.frame_list_.end ());
+    for (size_t idx = old_size; idx != frame_list_.size (); ++idx) {
+      frame_manager::incref (frame_list_[idx]);
+    }
+  }
+
+  // Returns true if both buffers refer to the same frames.
+  // Both buffers should be synchronized before this call.
+  bool
+  same_frames (const buffer& other) const
+  {
+    if (frame_list_.size () != other.frame_list_.size ()) {
+      return false;
+    }
+    for (frame_list_type::const_iterator x = frame_list_.begin (), y = other.frame_list_.begin ();
+	 x != frame_list_.end ();
+	 ++x, ++y) {
+      if (*x != *y) {
+	return false;
       }
     }
+    return true;
+  }
+
+  // Release all of the frames so the buffer can be reused.
+  // The frame list keeps its capacity.
+  void
+  clear ()
+  {
+    unmap ();
+    for (frame_list_type::const_iterator pos = frame_list_.begin (); pos != frame_list_.end (); ++pos) {
+      frame_manager::decref (*pos);
+    }
+    frame_list_.clear ();
   }
 
   void
@@ -224,6 +282,11 @@ public:
 	  // We don't need to increment the reference count for the new frame as it should be 1.
 	  vm::remap (begin_ + begin * PAGE_SIZE, vm::USER, vm::MAP_COPY_ON_WRITE, vm::BUFFER);
 	}
+	else if (!vm::is_copy_on_write (begin_ + begin * PAGE_SIZE)) {
+	  // The frame was not shared when written so it is writable.
+	  // Make it copy-on-write so the frame does not change after it is shared.
+	  vm::remap (begin_ + begin * PAGE_SIZE, vm::USER, vm::MAP_COPY_ON_WRITE, vm::BUFFER);
+	}
       }
     }
   }
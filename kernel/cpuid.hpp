@@ -0,0 +1,72 @@
+#ifndef __cpuid_hpp__
+#define __cpuid_hpp__
+
+/*
+  File
+  ----
+  cpuid.hpp
+
+  Description
+  -----------
+  Query the features of the processor.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+#include "integer_types.hpp"
+
+namespace cpuid {
+
+  // Features reported in edx by function 1.
+  enum feature_t {
+    PSE = (1 << 3),
+    PAE = (1 << 6),
+    PGE = (1 << 13),
+    SSE = (1 << 25),
+    SSE2 = (1 << 26),
+  };
+
+  // The cpuid instruction exists if the ID flag in eflags can be toggled.
+  inline bool
+  supported (void)
+  {
+    uint32_t before;
+    uint32_t after;
+    asm ("pushf\n"
+	 "pop %0\n"
+	 "mov %0, %1\n"
+	 "xor $0x200000, %1\n"
+	 "push %1\n"
+	 "popf\n"
+	 "pushf\n"
+	 "pop %1\n"
+	 "push %0\n"
+	 "popf\n" : "=&r"(before), "=&r"(after));
+    return ((before ^ after) & 0x200000) != 0;
+  }
+
+  inline uint32_t
+  features (void)
+  {
+    if (!supported ()) {
+      return 0;
+    }
+
+    uint32_t eax = 1;
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+    asm ("cpuid\n" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return edx;
+  }
+
+  inline bool
+  has (feature_t feature)
+  {
+    return (features () & feature) != 0;
+  }
+
+}
+
+#endif /* __cpuid_hpp__ */
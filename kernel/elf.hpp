@@ -4,6 +4,7 @@
 #include "integer_types.hpp"
 #include "buffer_file.hpp"
 #include "kstring.hpp"
+#include "elf_image.hpp"
 
 // I stole this from Linkers and Loaders (John R. Levine, p. 64).
 namespace elf {    
@@ -102,13 +103,11 @@ namespace elf {
     uint32_t action_description_size;
   };
 
-  typedef vector<program_header_entry> program_header_list_type;
   typedef unordered_map<logical_address_t, pair<frame_t, vm::map_mode_t> > frame_map_type;
-  typedef vector<pair<logical_address_t, logical_address_t> > clear_list_type;
 
-  // Interpret a region of memory as an ELF file.
+  // Interpret a region of memory as an ELF file and record the result in an image.
   int
-  parse (const shared_ptr<automaton>& a,
+  parse (elf_image& image,
 	 logical_address_t begin,
 	 logical_address_t end)
   {
@@ -200,8 +199,6 @@ namespace elf {
 
     // A list of frames used when creating automata.
     frame_map_type frame_map_;
-    // A list of frames to clear.
-    clear_list_type clear_list_;
 
     for (size_t idx = 0; idx != header_->program_header_entry_count; ++idx) {
       // Read the program header entries.
@@ -275,10 +272,11 @@ namespace elf {
 	  }
 	  
 	  // Clear the tiny region between the end of initialized data and the first unitialized page.
-	  if (e->file_size < e->memory_size) {
+	  // The uninitialized pages are the zero frame.
+	  if (e->file_size < e->memory_size && !is_aligned (e->virtual_address + e->file_size, PAGE_SIZE)) {
 	    logical_address_t begin = e->virtual_address + e->file_size;
-	    logical_address_t end = e->virtual_address + e->memory_size;
-	    clear_list_.push_back (make_pair (begin, end));
+	    logical_address_t end = min (static_cast<logical_address_t> (e->virtual_address + e->memory_size), align_up (begin, PAGE_SIZE));
+	    image.clear_list.push_back (make_pair (begin, end));
 	  }
 	  
 	  // Uninitialized data.
@@ -290,17 +288,8 @@ namespace elf {
 	    }
 	  }
 	  
-	  if (!a->vm_area_is_free (e->virtual_address, e->virtual_address + e->memory_size)) {
-	    // The area conflicts with the existing memory map.
-	    return -1;
-	  }
-	  
-	  a->insert_vm_area (new vm_area_base (e->virtual_address, e->virtual_address + e->memory_size));
-
-	  program_header_list_type program_headers_;
-	  
-	  // Record the header.
-	  program_headers_.push_back (*e);
+	  // Conflicts between areas are detected when instantiating the image.
+	  image.segments.push_back (elf_image::segment (e->virtual_address, e->virtual_address + e->memory_size));
 	}
 	break;
       case DYNAMIC:
@@ -406,10 +395,8 @@ namespace elf {
 		      return -1;
 		    }
 
-		    if (!a->add_action (static_cast<action_type_t> (d->action_type), static_cast<parameter_mode_t> (d->parameter_mode), reinterpret_cast<const void*> (d->action_entry_point), d->action_number, kstring (action_name, d->action_name_size), kstring (action_description, d->action_description_size))) {
-		      // Action conflicts.
-		      return -1;
-		    }
+		    // Conflicts between actions are detected when instantiating the image.
+		    image.add_action (new paction (static_cast<action_type_t> (d->action_type), static_cast<parameter_mode_t> (d->parameter_mode), reinterpret_cast<const void*> (d->action_entry_point), d->action_number, kstring (action_name, d->action_name_size), kstring (action_description, d->action_description_size)));
 		  }
 		  break;
 		default:
@@ -433,6 +420,45 @@ namespace elf {
       }
     }
 
+    // Record the frame of every page in each segment.
+    for (elf_image::segment_list_type::iterator pos = image.segments.begin ();
+	 pos != image.segments.end ();
+	 ++pos) {
+      for (logical_address_t address = align_down (pos->begin, PAGE_SIZE); address < pos->end; address += PAGE_SIZE) {
+	frame_map_type::const_iterator f = frame_map_.find (address);
+	kassert (f != frame_map_.end ());
+	pos->pages.push_back (f->second);
+      }
+    }
+
+    return 0;
+  }
+
+  // Build the memory map and page directory of an automaton from an image.
+  int
+  instantiate (const intrusive_ptr<automaton>& a,
+	       const elf_image& image)
+  {
+    for (elf_image::segment_list_type::const_iterator pos = image.segments.begin ();
+	 pos != image.segments.end ();
+	 ++pos) {
+      if (!a->vm_area_is_free (pos->begin, pos->end)) {
+	// The area conflicts with the existing memory map.
+	return -1;
+      }
+      
+      a->insert_vm_area (new vm_area_base (pos->begin, pos->end));
+    }
+
+    for (elf_image::action_list_type::const_iterator pos = image.actions ().begin ();
+	 pos != image.actions ().end ();
+	 ++pos) {
+      if (!a->add_action (*pos)) {
+	// Action conflicts.
+	return -1;
+      }
+    }
+
     if (!a->insert_heap_and_stack ()) {
       // Memory map interfers with heap and stack.
       return -1;
@@ -441,19 +467,12 @@ namespace elf {
     // Switch to the automaton.
     physical_address_t old = vm::switch_to_directory (a->page_directory);
     
-    // We can only use data in the kernel, i.e., we can't use automaton_text or hp.
-    
-    // Map all the frames.
-    for (frame_map_type::const_iterator pos = frame_map_.begin ();
-	 pos != frame_map_.end ();
-	 ++pos) {
-      vm::map (pos->first, pos->second.first, vm::USER, pos->second.second);
-    }
-    
+    // The other pages are mapped on demand.
     // Clear.
-    for (clear_list_type::const_iterator pos = clear_list_.begin ();
-	 pos != clear_list_.end ();
+    for (elf_image::clear_list_type::const_iterator pos = image.clear_list.begin ();
+	 pos != image.clear_list.end ();
 	 ++pos) {
+      a->map_image_page (pos->first);
       memset (reinterpret_cast<void*> (pos->first), 0, pos->second - pos->first);
     }
     
@@ -0,0 +1,155 @@
+#ifndef __elf_image_hpp__
+#define __elf_image_hpp__
+
+/*
+  File
+  ----
+  elf_image.hpp
+
+  Description
+  -----------
+  The parsed form of an automaton's text.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+#include "buffer.hpp"
+#include "action.hpp"
+#include "vector.hpp"
+#include "utility.hpp"
+
+/*
+  Creating an automaton requires mapping its text into the kernel and parsing it.
+  Systems often create many automata from the same text, e.g., one driver per device or one filter per terminal.
+  An image records the result of parsing the text:  the segments of the memory map, the frame to map for each page of a segment, the regions to clear, and the actions.
+  Automata created from the same text share an image and its actions so creating an automaton only requires building its page directory.
+
+  The pages of a segment are mapped on demand.
+  The page fault handler looks up the frame for a page that is not present in the image of the automaton.
+  Thus, creating an automaton is proportional to the number of segments and pages that are never used are never mapped.
+
+  An image is identified by the frames of its text and the size of the text.
+  The image holds a reference to every frame of the text.
+  Thus, the frames are copy-on-write for every other holder and the contents of a cached text cannot change.
+  The cache keeps the most recently used images and an image lives as long as an automaton uses its actions.
+*/
+
+class elf_image : public ref_counted {
+public:
+  struct segment {
+    logical_address_t begin;
+    logical_address_t end;
+    // The frame and map mode of each page starting with the page containing begin.
+    typedef vector<pair<frame_t, vm::map_mode_t> > page_list_type;
+    page_list_type pages;
+
+    segment (logical_address_t b,
+	     logical_address_t e) :
+      begin (b),
+      end (e)
+    { }
+  };
+
+  typedef vector<segment> segment_list_type;
+  typedef vector<pair<logical_address_t, logical_address_t> > clear_list_type;
+  typedef vector<const paction*> action_list_type;
+
+  elf_image (const buffer& text,
+	     size_t text_size) :
+    text_ (text),
+    text_size_ (text_size)
+  { }
+
+  ~elf_image ()
+  {
+    for (action_list_type::const_iterator pos = actions_.begin ();
+	 pos != actions_.end ();
+	 ++pos) {
+      delete *pos;
+    }
+  }
+
+  // Segments of the memory map.
+  segment_list_type segments;
+  // Regions to clear after mapping.
+  clear_list_type clear_list;
+
+  // Find the frame and map mode for the page containing address.
+  // Returns false if the address is not in a segment.
+  inline bool
+  lookup (logical_address_t address,
+	  frame_t& frame,
+	  vm::map_mode_t& map_mode) const
+  {
+    for (segment_list_type::const_iterator pos = segments.begin ();
+	 pos != segments.end ();
+	 ++pos) {
+      if (pos->begin <= address && address < pos->end) {
+	const pair<frame_t, vm::map_mode_t>& page = *(pos->pages.begin () + (address - align_down (pos->begin, PAGE_SIZE)) / PAGE_SIZE);
+	frame = page.first;
+	map_mode = page.second;
+	return true;
+      }
+    }
+
+    return false;
+  }
+
+  inline void
+  add_action (const paction* action)
+  {
+    actions_.push_back (action);
+  }
+
+  inline const action_list_type&
+  actions () const
+  {
+    return actions_;
+  }
+
+  // Return the cached image for the text or a null pointer.
+  // The text should be synchronized before this call.
+  static intrusive_ptr<elf_image>
+  find (const buffer& text,
+	size_t text_size)
+  {
+    for (cache_type::iterator pos = cache_.begin ();
+	 pos != cache_.end ();
+	 ++pos) {
+      if ((*pos)->text_size_ == text_size && (*pos)->text_.same_frames (text)) {
+	intrusive_ptr<elf_image> image = *pos;
+	// Move to the back so the least recently used image is first.
+	cache_.erase (pos);
+	cache_.push_back (image);
+	return image;
+      }
+    }
+
+    return intrusive_ptr<elf_image> ();
+  }
+
+  static void
+  insert (const intrusive_ptr<elf_image>& image)
+  {
+    if (cache_.size () == CACHE_LIMIT) {
+      cache_.erase (cache_.begin ());
+    }
+    cache_.push_back (image);
+  }
+
+private:
+  // Holds a reference to the frames of the text.
+  buffer const text_;
+  size_t const text_size_;
+  action_list_type actions_;
+
+  static const size_t CACHE_LIMIT = 8;
+  typedef vector<intrusive_ptr<elf_image> > cache_type;
+  static cache_type cache_;
+
+  elf_image (const elf_image&);
+  elf_image& operator= (const elf_image&);
+};
+
+#endif /* __elf_image_hpp__ */
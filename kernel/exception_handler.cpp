@@ -18,7 +18,7 @@
 #include "vm_def.hpp"
 #include "vm.hpp"
 #include "string.hpp"
-#include "kernel_alloc.hpp"
+#include "page_copy.hpp"
 #include "scheduler.hpp"
 
 extern "C" void exception0 ();
@@ -108,6 +108,53 @@ static const unsigned int GENERAL_PROTECTION_FAULT = 13;
 static const unsigned int PAGE_FAULT = 14;
 static const unsigned int COPROCESSOR_ERROR = 16;
 
+// Number of pages following a sequential copy-on-write fault that are resolved with it.
+// Larger windows trade memory for fewer faults when writing large buffers.
+static const size_t FAULT_AROUND_PAGES = 8;
+
+// Resolve a copy-on-write page, i.e., give it a private, writable frame.
+static void
+copy_on_write (logical_address_t address)
+{
+  // Is the frame part of a buffer?
+  vm::buffer_t buf = vm::get_buffer (address);
+  frame_t src_frame = vm::logical_address_to_frame (address);
+  if (src_frame != vm::zero_frame () && frame_manager::ref_count (src_frame) == 1) {
+    // The frame is not shared so we can just remap it.
+    vm::remap (address, vm::USER, vm::MAP_READ_WRITE, buf);
+  }
+  else if (src_frame == vm::zero_frame ()) {
+    // A copy of the zero frame is a zeroed frame so there is nothing to copy.
+    frame_t dst_frame = frame_manager::alloc_zeroed ();
+    vm::unmap (address, buf != vm::BUFFER);
+    vm::map (address, dst_frame, vm::USER, vm::MAP_READ_WRITE, true, buf);
+    // Remove the reference from allocation.  The final reference count for dst_frame is 1.
+    frame_manager::decref (dst_frame);
+  }
+  else {
+    // The frame is shared so make a copy.
+    // Allocate a frame.
+    frame_t dst_frame = frame_manager::alloc ();
+    kassert (dst_frame != vm::zero_frame ());
+    // Map it in at the stub.
+    vm::map (vm::get_stub1 (), dst_frame, vm::USER, vm::MAP_READ_WRITE);
+    // Copy.
+    page_copy::copy (reinterpret_cast<void *> (vm::get_stub1 ()), reinterpret_cast<const void*> (address));
+    // Unmap the source.  Decrement if not a buffer.
+    vm::unmap (address, buf != vm::BUFFER);
+    // Unmap the stub.
+    vm::unmap (vm::get_stub1 ());
+    // Map in the destination with the same buffer status.
+    vm::map (address, dst_frame, vm::USER, vm::MAP_READ_WRITE, true, buf);
+    // Remove the reference from allocation.  The final reference count for dst_frame is 1.
+    frame_manager::decref (dst_frame);
+
+    // static size_t copy_count = 0;
+    // kout << scheduler::current_action ().action->automaton->aid () << " " <<
+    //   hexformat (address) << " copy_count = " << ++copy_count << " " << dst_frame << " -> " << src_frame << endl;
+  }
+}
+
 extern "C" void
 exception_dispatch (volatile registers regs)
 {
@@ -162,59 +209,45 @@ exception_dispatch (volatile registers regs)
       // Get the error.
       vm::page_fault_error_t error = regs.error;
 
+      if (vm::not_present (error) &&
+	  address < KERNEL_VIRTUAL_BASE &&
+	  scheduler::executing () &&
+	  vm::get_directory () == scheduler::current_automaton ()->page_directory &&
+	  scheduler::current_automaton ()->map_image_page (address)) {
+	// The first access to a page of the image.
+	return;
+      }
+
       if (!vm::not_present (error) &&
       	  vm::protection_violation (error) &&
       	  vm::write_context (error) &&
       	  vm::data_context (error) &&
       	  vm::get_copy_on_write (address) == vm::COPY_ON_WRITE) {
       	// Copy-on-write.
-	// Is the frame part of a buffer?
-	vm::buffer_t buf = vm::get_buffer (address);
-	frame_t src_frame = vm::logical_address_to_frame (address);
-	if (src_frame != vm::zero_frame () && frame_manager::ref_count (src_frame) == 1) {
-	  // The frame is not shared so we can just remap it.
-	  vm::remap (address, vm::USER, vm::MAP_READ_WRITE, buf);
+	const logical_address_t page = align_down (address, PAGE_SIZE);
+	logical_address_t end = page + PAGE_SIZE;
+	if (scheduler::executing () && vm::get_directory () == scheduler::current_automaton ()->page_directory) {
+	  const intrusive_ptr<automaton>& a = scheduler::current_automaton ();
+	  if (a->copy_on_write_fault (page) && a->can_fault_around (FAULT_AROUND_PAGES)) {
+	    // The automaton is writing sequentially so resolve the pages that follow.
+	    // Adjacent areas may also be copy-on-write so stop at the end of the faulting area.
+	    const logical_address_t limit = min (page + (FAULT_AROUND_PAGES + 1) * PAGE_SIZE, align_up (a->area_end (page), PAGE_SIZE));
+	    while (end < limit &&
+		   vm::is_copy_on_write (end)) {
+	      end += PAGE_SIZE;
+	    }
+	  }
+	  a->copy_on_write_resolved (page, end);
 	}
-	else {
-	  // The frame is shared so make a copy.
-	  // Allocate a frame.
-	  frame_t dst_frame = frame_manager::alloc ();
-	  kassert (dst_frame != vm::zero_frame ());
-	  // Map it in at the stub.
-	  vm::map (vm::get_stub1 (), dst_frame, vm::USER, vm::MAP_READ_WRITE);
-	  // Copy.
-	  memcpy (reinterpret_cast<void *> (vm::get_stub1 ()), reinterpret_cast<const void*> (align_down (address, PAGE_SIZE)), PAGE_SIZE);
-	  // Unmap the source.  Decrement if not a buffer.
-	  vm::unmap (address, buf != vm::BUFFER);
-	  // Unmap the stub.
-	  vm::unmap (vm::get_stub1 ());
-	  // Map in the destination with the same buffer status.
-	  vm::map (address, dst_frame, vm::USER, vm::MAP_READ_WRITE, true, buf);
-	  // Remove the reference from allocation.  The final reference count for dst_frame is 1.
-	  frame_manager::decref (dst_frame);
 
-	  // static size_t copy_count = 0;
-	  // kout << scheduler::current_action ().action->automaton->aid () << " " <<
-	  //   hexformat (address) << " copy_count = " << ++copy_count << " " << dst_frame << " -> " << src_frame << endl;
+	for (logical_address_t la = page; la != end; la += PAGE_SIZE) {
+	  copy_on_write (la);
 	}
 
       	// Done.
       	return;
       }
 
-      if (vm::not_present (error) &&
-      	  vm::supervisor_context (error) &&
-      	  address >= kernel_alloc::heap_begin () &&
-      	  address < kernel_alloc::heap_end ()) {
-      	// The kernel expanded since the current page directory was created.
-      	// Consequently, we may encounter a page fault when trying to access something in the kernel.
-      	// We only need to map the page table, however.
-      	const size_t idx = vm::get_page_directory_idx (address);
-      	vm::get_page_directory ()->entry[idx] = vm::get_kernel_page_directory ()->entry[idx];
-      	asm ("invlpg (%0)\n" : : "r"(address));
-      	return;
-      }
-
       kout << "Page Fault" << endl;
       kout << "address = " << hexformat (address) << endl;
       // kout << "not_present = " << vm::not_present (error) << endl;
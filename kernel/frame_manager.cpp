@@ -12,35 +12,142 @@
 */
 
 #include "frame_manager.hpp"
-#include "vm_def.hpp"
+#include "vm.hpp"
+#include "page_copy.hpp"
 
 void
-frame_manager::add (physical_address_t begin,
-		    physical_address_t end)
+frame_manager::add (frame_t begin,
+		    frame_t end)
 {
-  kassert (begin >= USABLE_MEMORY_BEGIN);
-  kassert (end <= USABLE_MEMORY_END);
-  kassert (is_aligned (begin, PAGE_SIZE));
-  kassert (is_aligned (end, PAGE_SIZE));
+  kassert (begin >= physical_address_to_frame (USABLE_MEMORY_BEGIN));
+  kassert (end <= (USABLE_MEMORY_END >> FRAME_SHIFT));
   kassert (begin < end);
-  
-  size_t size = end - begin;
-  while (size != 0) {
-    size_t sz = min (size_t (stack_allocator::MAX_REGION_SIZE), size);
-    allocator_list_.push_back (new stack_allocator (physical_address_to_frame (begin), physical_address_to_frame (begin + sz)));
-    size -= sz;
-    begin += sz;
+
+  if (deferring_ && end > BOOT_FRAME_LIMIT) {
+    // Add the memory above the limit once the heap can grow.
+    const frame_t split = max (begin, frame_t (BOOT_FRAME_LIMIT));
+    deferred_list_.push_back (make_pair (split, end));
+    end = split;
+  }
+
+  frame_t frame = begin;
+  while (frame != end) {
+    const size_t region = frame >> REGION_SHIFT;
+    const frame_t region_begin = region << REGION_SHIFT;
+    const frame_t region_end = region_begin + REGION_FRAMES;
+
+    if (region_table_[region] == 0) {
+      // All frames in a new allocator are used.
+      region_table_[region] = new stack_allocator (region_begin, region_end);
+      allocator_list_type::iterator pos = allocator_list_.begin ();
+      while (pos != allocator_list_.end () && (*pos)->begin () < region_begin) {
+	++pos;
+      }
+      allocator_list_.insert (pos, region_table_[region]);
+    }
+
+    // Make the usable frames available.
+    const frame_t e = min (region_end, end);
+    region_table_[region]->release (frame, e);
+    free_count_ += e - frame;
+    // Frames that were marked as used while their region was deferred.
+    for (reserved_list_type::const_iterator pos = reserved_list_.begin (); pos != reserved_list_.end (); ++pos) {
+      if (*pos >= frame && *pos < e && region_table_[region]->mark_as_used (*pos)) {
+	--free_count_;
+      }
+    }
+    frame = e;
+  }
+}
+
+void
+frame_manager::add_deferred ()
+{
+  kassert (deferring_);
+  deferring_ = false;
+
+  for (deferred_list_type::const_iterator pos = deferred_list_.begin (); pos != deferred_list_.end (); ++pos) {
+    add (pos->first, pos->second);
   }
+
+  deferred_list_.clear ();
+  reserved_list_.clear ();
 }
 
 void
 frame_manager::mark_as_used (frame_t frame)
 {
-  allocator_list_type::iterator pos = find_allocator (frame);
+  stack_allocator* sa = region_table_[frame >> REGION_SHIFT];
+
+  if (sa != 0) {
+    if (sa->mark_as_used (frame)) {
+      --free_count_;
+    }
+  }
+  else if (deferring_ && frame >= BOOT_FRAME_LIMIT) {
+    reserved_list_.push_back (frame);
+  }
+}
+
+void
+frame_manager::zero (frame_t frame)
+{
+  vm::map (vm::get_stub1 (), frame, vm::SUPERVISOR, vm::MAP_READ_WRITE);
+  page_copy::clear (reinterpret_cast<void*> (vm::get_stub1 ()));
+  vm::unmap (vm::get_stub1 ());
+}
+
+frame_t
+frame_manager::alloc_low ()
+{
+  // The allocators are in order of address and a region never crosses 4GB so the first allocator with a free frame has the lowest frames.
+  allocator_list_type::iterator pos = find_if (allocator_list_.begin (), allocator_list_.end (), stack_allocator_not_full ());
+  if (pos == allocator_list_.end () || (*pos)->end () > LOW_FRAME_END) {
+    // Frame 0 is never usable.
+    return 0;
+  }
+  --free_count_;
+  return (*pos)->alloc ();
+}
+
+frame_t
+frame_manager::alloc_zeroed ()
+{
+  if (zeroed_count_ != 0) {
+    --free_count_;
+    return zeroed_frames_[--zeroed_count_];
+  }
 
-  if (pos != allocator_list_.end ()) {
-    (*pos)->mark_as_used (frame);
+  // The pool is empty so zero a frame on demand.
+  frame_t frame = alloc ();
+  zero (frame);
+  return frame;
+}
+
+void
+frame_manager::fill_zeroed_pool ()
+{
+  while (zeroed_count_ != ZEROED_POOL_LIMIT) {
+    if (current_ == 0 || current_->full ()) {
+      if (find_if (allocator_list_.begin (), allocator_list_.end (), stack_allocator_not_full ()) == allocator_list_.end ()) {
+	// Don't take the last free frames.
+	return;
+      }
+    }
+    frame_t frame = alloc ();
+    zero (frame);
+    // Frames in the pool are still free.
+    ++free_count_;
+    zeroed_frames_[zeroed_count_++] = frame;
   }
 }
 
+stack_allocator* frame_manager::region_table_[frame_manager::REGION_COUNT];
 frame_manager::allocator_list_type frame_manager::allocator_list_;
+stack_allocator* frame_manager::current_ = 0;
+bool frame_manager::deferring_ = true;
+frame_manager::deferred_list_type frame_manager::deferred_list_;
+frame_manager::reserved_list_type frame_manager::reserved_list_;
+size_t frame_manager::free_count_ = 0;
+frame_t frame_manager::zeroed_frames_[frame_manager::ZEROED_POOL_LIMIT];
+size_t frame_manager::zeroed_count_ = 0;
@@ -17,6 +17,10 @@
 
 #include "stack_allocator.hpp"
 #include "vector.hpp"
+#include "utility.hpp"
+
+// A frame containing nothing but zeroes.
+extern int zero_page;
 
 /*
   The frame manager was designed under the following requirements and assumptions:
@@ -32,12 +36,36 @@
   However, this should only require expanding the interface and changing the implementation as opposed to redesigning the interface.
  */
 
+/*
+  Each region of REGION_FRAMES frames (4MB) that contains usable memory has a stack allocator.
+  Regions are aligned so the allocator for a frame is found by indexing the region table with the frame number.
+  Thus, reference counting requires two array look-ups instead of searching the list of allocators.
+  Frames in a region that are not usable are permanently marked as used.
+
+  The table of a region is allocated from the kernel heap which is limited to the initial 4MB of logical memory until the heap is backed by frames.
+  Thus, only the tables for regions below BOOT_FRAME_LIMIT are allocated when memory is added during boot.
+  The rest of the memory is recorded and added by add_deferred once the heap can grow.
+
+  The zero frame backs every untouched page of every buffer, heap, and bss.
+  It is never freed or written so it is exempt from reference counting.
+  This keeps creating large, sparse buffers from overflowing its count and avoids the work of counting.
+
+  Writing to the zero frame requires a frame full of zeroes.
+  The scheduler zeroes frames when it is idle and places them in a small pool so a write to the zero frame can be satisfied without clearing a frame.
+  Frames in the pool are allocated but are reclaimed when all other frames are exhausted.
+ */
+
 class frame_manager {
 public:
+  /* Make the frames [begin, end) available.  Frames are used instead of physical addresses so that memory above 4GB can be added with PAE. */
   static void
-  add (physical_address_t begin,
-       physical_address_t end);
+  add (frame_t begin,
+       frame_t end);
   
+  /* Add the memory that was deferred during boot.  Called once the kernel heap can allocate frames. */
+  static void
+  add_deferred ();
+
   /* This function allows a frame to be marked as used when initializing virtual memory. */
   static void
   mark_as_used (frame_t frame);
@@ -46,75 +74,136 @@ public:
   static inline frame_t
   alloc ()
   {
-    /* Find an allocator with a free frame. */
-    allocator_list_type::iterator pos = find_if (allocator_list_.begin (), allocator_list_.end (), stack_allocator_not_full ());
-    
-    /* Out of frames. */
-    kassert (pos != allocator_list_.end ());
+    if (current_ == 0 || current_->full ()) {
+      /* Find an allocator with a free frame. */
+      allocator_list_type::iterator pos = find_if (allocator_list_.begin (), allocator_list_.end (), stack_allocator_not_full ());
+      
+      if (pos == allocator_list_.end ()) {
+	/* Out of frames.  Take one from the zeroed pool. */
+	kassert (zeroed_count_ != 0);
+	--free_count_;
+	return zeroed_frames_[--zeroed_count_];
+      }
+
+      current_ = *pos;
+    }
   
-    return (*pos)->alloc ();
+    --free_count_;
+    return current_->alloc ();
   }
+
+  /* Allocate a frame with a 32-bit physical address, e.g., for a page directory pointer table.
+     Returns 0 if there are no free frames below 4GB. */
+  static frame_t
+  alloc_low ();
+
+  /* Number of frames that can be allocated including the zeroed pool. */
+  static inline size_t
+  free_count ()
+  {
+    return free_count_;
+  }
+
+  /* Allocate a frame that contains all zeroes. */
+  static frame_t
+  alloc_zeroed ();
+
+  /* Zero free frames until the zeroed pool is full.  Called when idle. */
+  static void
+  fill_zeroed_pool ();
   
   /* Increment the reference count for a frame. */
   static inline size_t
   incref (frame_t frame,
 	  size_t count = 1)
   {
-    allocator_list_type::iterator pos = find_allocator (frame);
-    
-    /* No allocator for frame. */
-    kassert (pos != allocator_list_.end ());
-    
-    return (*pos)->incref (frame, count);
+    if (is_zero_frame (frame)) {
+      return ZERO_FRAME_REF_COUNT;
+    }
+    return find_allocator (frame)->incref (frame, count);
   }
   
   /* Decrement the reference count for a frame. */
   static inline size_t
   decref (frame_t frame)
   {
-    allocator_list_type::iterator pos = find_allocator (frame);
-    
-    /* No allocator for frame. */
-    kassert (pos != allocator_list_.end ());
-    
-    return (*pos)->decref (frame);
+    if (is_zero_frame (frame)) {
+      return ZERO_FRAME_REF_COUNT;
+    }
+    const size_t count = find_allocator (frame)->decref (frame);
+    if (count == 0) {
+      ++free_count_;
+    }
+    return count;
   }
 
   /* Return the reference count for a frame. */
   static inline size_t
   ref_count (frame_t frame)
   {
-    allocator_list_type::iterator pos = find_allocator (frame);
-    
-    /* No allocator for frame. */
-    kassert (pos != allocator_list_.end ());
-    
-    return (*pos)->ref_count (frame);
+    if (is_zero_frame (frame)) {
+      return ZERO_FRAME_REF_COUNT;
+    }
+    return find_allocator (frame)->ref_count (frame);
   }
 
 private:
+  // The zero frame always appears to be shared so it is copied on write and never freed.
+  static const size_t ZERO_FRAME_REF_COUNT = 2;
+
+  static inline bool
+  is_zero_frame (frame_t frame)
+  {
+    return frame == physical_address_to_frame (reinterpret_cast<physical_address_t> (&zero_page));
+  }
+
+  // Frames in the allocators and the zeroed pool.
+  static size_t free_count_;
+
+  static const size_t ZEROED_POOL_LIMIT = 64;
+  static frame_t zeroed_frames_[ZEROED_POOL_LIMIT];
+  static size_t zeroed_count_;
+
+  static void
+  zero (frame_t frame);
+
+  static const size_t REGION_SHIFT = 10;
+  static const size_t REGION_FRAMES = (1 << REGION_SHIFT);
+  static const size_t REGION_COUNT = (1 << (PHYSICAL_ADDRESS_BITS - FRAME_SHIFT - REGION_SHIFT));
+
+  // Allocator for each region or 0 if the region has no usable memory.
+  static stack_allocator* region_table_[REGION_COUNT];
+
+  // All of the allocators in order of address.
   typedef vector<stack_allocator*> allocator_list_type;
   static allocator_list_type allocator_list_;
 
-  struct contains_frame {
-    frame_t f;
+  // The allocator that satisfied the last allocation.
+  static stack_allocator* current_;
 
-    contains_frame (frame_t x) :
-      f (x)
-    { }
+  // The tables for the regions below 1GB take at most 1MB of the initial heap.
+  static const frame_t BOOT_FRAME_LIMIT = 256 * REGION_FRAMES;
 
-    inline bool
-    operator() (stack_allocator* const & sa) const
-    {
-      return f >= sa->begin () && f < sa->end ();
-    }
-  };
+  // True until add_deferred is called.
+  static bool deferring_;
 
-  static inline allocator_list_type::iterator
+  // Memory above BOOT_FRAME_LIMIT added during boot.
+  typedef vector<pair<frame_t, frame_t> > deferred_list_type;
+  static deferred_list_type deferred_list_;
+
+  // Frames above BOOT_FRAME_LIMIT marked as used during boot.
+  typedef vector<frame_t> reserved_list_type;
+  static reserved_list_type reserved_list_;
+
+  static inline stack_allocator*
   find_allocator (frame_t frame)
   {
-    // TODO:  Sort the stack allocators and use binary search.
-    return find_if (allocator_list_.begin (), allocator_list_.end (), contains_frame (frame));
+    stack_allocator* sa = region_table_[frame >> REGION_SHIFT];
+
+    /* No allocator for frame. */
+    kassert (sa != 0);
+
+    return sa;
   }
 
   struct stack_allocator_not_full {
@@ -1,7 +1,7 @@
 #ifndef __functional_hpp__
 #define __functional_hpp__
 
-#include "shared_ptr.hpp"
+#include "intrusive_ptr.hpp"
 
 template <typename A1,
 	  typename Result>
@@ -91,9 +91,9 @@ struct hash<unsigned long> : public unary_function<unsigned long, size_t> {
 };
 
 template <typename T>
-struct hash<shared_ptr<T> > : public unary_function<shared_ptr<T>, size_t> {
+struct hash<intrusive_ptr<T> > : public unary_function<intrusive_ptr<T>, size_t> {
   size_t
-  operator () (const shared_ptr<T>& p) const
+  operator () (const intrusive_ptr<T>& p) const
   {
     return reinterpret_cast<size_t> (p.get ());
   }
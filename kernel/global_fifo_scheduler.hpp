@@ -35,7 +35,7 @@ private:
   typedef linear_set<caction, caction_hash> automaton_context;
 
   // Map an automaton to its scheduling context.
-  typedef unordered_map<shared_ptr<automaton>, automaton_context*> context_map_type;
+  typedef unordered_map<intrusive_ptr<automaton>, automaton_context*> context_map_type;
   static context_map_type context_map_;
 
   // Queue of automaton with actions to execute.
@@ -46,20 +46,21 @@ private:
   static caction action_;
 
   // List of input actions to be used when executing bound output actions.
-  typedef vector<shared_ptr<binding> > input_action_list_type;
+  typedef vector<intrusive_ptr<binding> > input_action_list_type;
   static input_action_list_type input_action_list_;
 
   // Iterator that marks our progress when executing input actions.
   static input_action_list_type::const_iterator input_action_pos_;
 
   // Buffers produced by an output action that will be copied to the input action.
-  static shared_ptr<buffer> output_buffer_a_;
-  static shared_ptr<buffer> output_buffer_b_;
+  // A null entry is delivered as the descriptor -1.
+  typedef vector<intrusive_ptr<buffer> > output_buffer_list_type;
+  static output_buffer_list_type output_buffers_;
 
   struct sort_bindings_by_input {
     bool
-    operator () (const shared_ptr<binding>& x,
-		 const shared_ptr<binding>& y) const
+    operator () (const intrusive_ptr<binding>& x,
+		 const intrusive_ptr<binding>& y) const
     {
       return x->input_action.automaton->aid () < y->input_action.automaton->aid ();
     }
@@ -68,11 +69,11 @@ private:
   static inline void
   proceed_to_input (void)
   {
-    // Do not use temporary shared_ptr<binding> because it will not be destroyed if execute is called.
+    // Do not use temporary intrusive_ptr<binding> because it will not be destroyed if execute is called.
     while (input_action_pos_ != input_action_list_.end ()) {
       if ((*input_action_pos_)->enabled ()) {
 	action_ = (*input_action_pos_)->input_action;
-	action_.automaton->execute (*action_.action, action_.parameter, output_buffer_a_, output_buffer_b_);
+	action_.automaton->execute (*action_.action, action_.parameter, output_buffers_);
       }
       else {
 	++input_action_pos_;
@@ -90,8 +91,48 @@ private:
       (*pos)->input_action.automaton->unlock_execution ();
     }
     input_action_list_.clear ();
+    output_buffers_.clear ();
   }
 
+  static inline bool
+  output_firing (bool output_fired)
+  {
+    return output_fired && action_.automaton.get () != 0 && action_.action->type == OUTPUT;
+  }
+
+  // Add a whole buffer of the output automaton to the list of output buffers.
+  static inline void
+  push_output_buffer (bd_t bd)
+  {
+    intrusive_ptr<buffer> b = action_.automaton->lookup_buffer (bd);
+    if (b.get () != 0) {
+      // Synchronize the buffer.
+      b->sync (0, b->size ());
+    }
+    output_buffers_.push_back (b);
+  }
+
+  // Add a range of pages of a buffer of the output automaton to the list of output buffers.
+  static inline void
+  push_output_range (const buffer_range_t& range)
+  {
+    intrusive_ptr<buffer> b = action_.automaton->lookup_buffer (range.bd);
+    if (b.get () == 0 || range.begin > range.end || range.end > b->size ()) {
+      // Bad range.
+      output_buffers_.push_back (intrusive_ptr<buffer> ());
+    }
+    else if (range.begin == 0 && range.end == b->size ()) {
+      // The whole buffer.
+      b->sync (0, b->size ());
+      output_buffers_.push_back (b);
+    }
+    else {
+      // Make a buffer of the range.  This synchronizes the range.
+      output_buffers_.push_back (intrusive_ptr<buffer> (new buffer (*b, range.begin, range.end)));
+    }
+  }
+
+
 public:
   static void
   initialize ()
@@ -99,7 +140,7 @@ public:
   }
 
   static inline void
-  add_automaton (const shared_ptr<automaton>& a)
+  add_automaton (const intrusive_ptr<automaton>& a)
   {
     // Allocate a new context and insert it into the map.
     // Inserting should succeed.
@@ -109,7 +150,7 @@ public:
   }
 
   static inline void
-  remove_automaton (const shared_ptr<automaton>& a)
+  remove_automaton (const intrusive_ptr<automaton>& a)
   {
     context_map_type::iterator pos = context_map_.find (a);
     kassert (pos != context_map_.end ());
@@ -120,7 +161,14 @@ public:
     delete c;
   }
 
-  static inline const shared_ptr<automaton>&
+  // Returns true if an action is executing, i.e., current_automaton and current_action are valid.
+  static inline bool
+  executing ()
+  {
+    return action_.automaton.get () != 0;
+  }
+
+  static inline const intrusive_ptr<automaton>&
   current_automaton ()
   {
     kassert (action_.automaton.get () != 0);
@@ -162,6 +210,47 @@ public:
   finish (bool output_fired,
 	  bd_t bda,
 	  bd_t bdb)
+  {
+    if (output_firing (output_fired)) {
+      push_output_buffer (bda);
+      push_output_buffer (bdb);
+    }
+    else if (action_.automaton.get () != 0 && action_.action->type == INPUT) {
+      // An input names the buffers it wants destroyed which saves two system calls per message.
+      action_.automaton->buffer_destroy (bda);
+      action_.automaton->buffer_destroy (bdb);
+      // The input did not see the rest of the list.
+      action_.automaton->destroy_input_list ();
+    }
+    proceed (output_fired);
+  }
+
+  // Finish with a list of buffer ranges.
+  // The caller must verify that the list is in the address space of the automaton.
+  static inline void
+  finish (bool output_fired,
+	  const buffer_range_t* ranges,
+	  size_t count)
+  {
+    if (output_firing (output_fired)) {
+      for (size_t idx = 0; idx != count; ++idx) {
+	push_output_range (ranges[idx]);
+      }
+    }
+    else if (action_.automaton.get () != 0 && action_.action->type == INPUT) {
+      // An input with a list names all of the buffers it wants destroyed.
+      for (size_t idx = 0; idx != count; ++idx) {
+	action_.automaton->buffer_destroy (ranges[idx].bd);
+      }
+      action_.automaton->forget_input_list ();
+    }
+    proceed (output_fired);
+  }
+
+private:
+  // Does not return.
+  static inline void
+  proceed (bool output_fired)
   {
     if (action_.automaton.get () != 0) {
       // We were executing an action of this automaton.
@@ -179,15 +268,7 @@ public:
 	// We were executing an output ...
 	if (output_fired) {
 	  // ... and the output output did something.
-	  output_buffer_a_ = action_.automaton->lookup_buffer (bda);
-	  // Synchronize the buffers.
-	  if (output_buffer_a_.get () != 0) {
-	    output_buffer_a_->sync (0, output_buffer_a_->size ());
-	  }
-	  output_buffer_b_ = action_.automaton->lookup_buffer (bdb);
-	  if (output_buffer_b_.get () != 0) {
-	    output_buffer_b_->sync (0, output_buffer_b_->size ());
-	  }
+	  // The output buffers have already been collected and synchronized.
 	  // Proceed to execute the inputs.
 	  input_action_pos_ = input_action_list_.begin ();
 	  // This does not return if there are inputs.
@@ -207,13 +288,16 @@ public:
     }
 
     // We are done with the current action.
-    action_.automaton = shared_ptr<automaton> ();
+    action_.automaton = intrusive_ptr<automaton> ();
 
     for (;;) {
 
       irq_handler::process_interrupts ();
 
       while (!ready_queue_.empty ()) {
+	// Do not wait for idle time to reclaim destroyed automata.
+	automaton::reclaim_destroyed_before_action ();
+
 	// Get the automaton context and remove it from the ready queue.
 	automaton_context* c = ready_queue_.front ();
 	ready_queue_.pop_front ();
@@ -242,7 +326,7 @@ public:
 	    for (input_action_list_type::const_iterator pos = input_action_list_.begin ();
 		 pos != input_action_list_.end ();
 		 ++pos) {
-	      shared_ptr<automaton> input_automaton = (*pos)->input_action.automaton;
+	      intrusive_ptr<automaton> input_automaton = (*pos)->input_action.automaton;
 	      if (!output_locked && action_.automaton->aid () < input_automaton->aid ()) {
 		// +EEE
 		action_.automaton->lock_execution ();
@@ -272,11 +356,18 @@ public:
 	  ready_queue_.push_back (c);
 	}
 
-	action_.automaton->execute (*action_.action, action_.parameter, output_buffer_a_, output_buffer_b_);
+	action_.automaton->execute (*action_.action, action_.parameter, output_buffers_);
       }
 
       // Out of actions.
-      action_.automaton = shared_ptr<automaton> ();
+      action_.automaton = intrusive_ptr<automaton> ();
+      // Use the idle time to reclaim destroyed automata in chunks.
+      // Check for actions between chunks.
+      if (automaton::reclaim_destroyed ()) {
+	continue;
+      }
+      // Use the idle time to prepare zeroed frames for copy-on-write faults.
+      frame_manager::fill_zeroed_pool ();
       irq_handler::wait_for_interrupt ();
     }
   }
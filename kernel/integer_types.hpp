@@ -11,6 +11,7 @@ typedef unsigned short uint16_t;
 #endif 
 
 #if __SIZEOF_INT__ == 4
+typedef signed int int32_t;
 typedef unsigned int uint32_t;
 #endif
 
@@ -20,6 +21,9 @@ typedef unsigned long long uint64_t;
 
 #if __SIZEOF_INT__ == __SIZEOF_POINTER__
 typedef unsigned int uintptr_t;
+#elif __SIZEOF_LONG__ == __SIZEOF_POINTER__
+// Hosted builds of the containers, e.g., user/container_test.
+typedef unsigned long uintptr_t;
 #endif
 
 #endif /* __types_hpp__ */
@@ -0,0 +1,138 @@
+#ifndef __intrusive_ptr_hpp__
+#define __intrusive_ptr_hpp__
+
+/*
+  File
+  ----
+  intrusive_ptr.hpp
+  
+  Description
+  -----------
+  Reference counted pointers where the count is stored in the object.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+#include <stddef.h>
+
+/*
+  A shared pointer with a separate count must allocate the count for every pointer, even a null one, and touches two cache lines for every copy.
+  Objects managed by intrusive_ptr derive from ref_counted which holds the count.
+  Creating, copying, and destroying a null intrusive_ptr does not allocate or touch memory.
+  The object is deleted when the last intrusive_ptr referring to it is destroyed.
+*/
+
+// TODO:  Make these operations atomic.
+class ref_counted {
+public:
+  ref_counted () :
+    ref_count_ (0)
+  { }
+
+  // A copy is a new object with its own count.
+  ref_counted (const ref_counted&) :
+    ref_count_ (0)
+  { }
+
+  ref_counted&
+  operator= (const ref_counted&)
+  {
+    return *this;
+  }
+
+private:
+  size_t ref_count_;
+
+  template <typename T>
+  friend class intrusive_ptr;
+};
+
+template <typename T>
+class intrusive_ptr {
+private:
+  T* ptr;
+
+public:
+  explicit intrusive_ptr (T* p = 0) :
+    ptr (p)
+  {
+    incref ();
+  }
+
+  intrusive_ptr (const intrusive_ptr<T>& p) :
+    ptr (p.ptr)
+  {
+    incref ();
+  }
+
+  intrusive_ptr<T>&
+  operator= (const intrusive_ptr<T>& p)
+  {
+    // Increment first in case p refers to this.
+    T* old = ptr;
+    ptr = p.ptr;
+    incref ();
+    dispose (old);
+    return *this;
+  }
+
+  ~intrusive_ptr ()
+  {
+    dispose (ptr);
+  }
+
+  inline T&
+  operator* () const
+  {
+    return *ptr;
+  }
+
+  inline T*
+  operator-> () const
+  {
+    return ptr;
+  }
+
+  inline T*
+  get () const
+  {
+    return ptr;
+  }
+
+  // True if this is the only reference.
+  inline bool
+  unique () const
+  {
+    return ptr != 0 && static_cast<const ref_counted*> (ptr)->ref_count_ == 1;
+  }
+
+  inline bool
+  operator== (const intrusive_ptr<T>& other) const
+  {
+    return ptr == other.ptr;
+  }
+
+  inline bool
+  operator!= (const intrusive_ptr<T>& other) const
+  {
+    return ptr != other.ptr;
+  }
+
+private:
+  inline void
+  incref () {
+    if (ptr != 0) {
+      ++static_cast<ref_counted*> (ptr)->ref_count_;
+    }
+  }
+
+  static inline void
+  dispose (T* p) {
+    if (p != 0 && --static_cast<ref_counted*> (p)->ref_count_ == 0) {
+      delete p;
+    }
+  }
+};
+
+#endif /* __intrusive_ptr_hpp__ */
@@ -23,6 +23,8 @@
 #include "trap_handler.hpp"
 #include "frame_manager.hpp"
 #include "vm.hpp"
+#include "cpuid.hpp"
+#include "page_copy.hpp"
 #include "halt.hpp"
 #include "scheduler.hpp"
 #include "boot_automaton.hpp"
@@ -193,10 +195,14 @@ kmain (uint32_t multiboot_magic,
   	  // Intersect the region of memory with usable memory.
   	  uint64_t begin = max (static_cast<multiboot_uint64_t> (USABLE_MEMORY_BEGIN), pos->addr);
   	  uint64_t end = min (static_cast<multiboot_uint64_t> (USABLE_MEMORY_END), pos->addr + pos->len);
-  	  begin = align_down (begin, PAGE_SIZE);
-  	  end = align_up (end, PAGE_SIZE);
   	  if (begin < end) {
-  	    frame_manager::add (pos->addr, pos->addr + pos->len);
+  	    // Only use whole frames.
+  	    // The addresses may not fit in a physical_address_t so convert them to frames directly.
+  	    const frame_t begin_frame = (begin + PAGE_SIZE - 1) >> FRAME_SHIFT;
+  	    const frame_t end_frame = end >> FRAME_SHIFT;
+  	    if (begin_frame < end_frame) {
+  	      frame_manager::add (begin_frame, end_frame);
+  	    }
   	  }
   	}
   	break;
@@ -223,8 +229,9 @@ kmain (uint32_t multiboot_magic,
   	  true,
   	  vm::MAP_READ_WRITE);
   
+    // The loader uses one page table for each page directory entry spanned by the initial logical memory.
     mark (reinterpret_cast<logical_address_t> (&kernel_page_table) + KERNEL_VIRTUAL_BASE,
-  	  reinterpret_cast<logical_address_t> (&kernel_page_table) + KERNEL_VIRTUAL_BASE + sizeof (vm::page_table),
+  	  reinterpret_cast<logical_address_t> (&kernel_page_table) + KERNEL_VIRTUAL_BASE + (INITIAL_LOGICAL_LIMIT - KERNEL_VIRTUAL_BASE) / LARGE_PAGE_SIZE * sizeof (vm::page_table),
   	  false,
   	  vm::MAP_READ_WRITE);
   
@@ -270,9 +277,35 @@ kmain (uint32_t multiboot_magic,
     sweep ();
   }
 
+  // Remove the identity mapping used when enabling paging.
+  for (page_table_idx_t idx = 0; idx != vm::get_page_directory_idx (INITIAL_LOGICAL_LIMIT - KERNEL_VIRTUAL_BASE); ++idx) {
+    vm::get_page_directory ()->entry[idx] = vm::page_directory_entry ();
+  }
+  vm::flush_tlb ();
+
+  // Allocate all of the kernel page tables so that every page directory shares them.
+  vm::populate_kernel_page_tables ();
+
+  // Kernel pages are marked global so they survive switching page directories.
+  if (cpuid::has (cpuid::PGE)) {
+    vm::enable_global_pages ();
+  }
+
+  // Memory mapped I/O regions use 4MB pages when possible.
+  // With PAE, they use 2MB pages which need no support beyond PAE itself.
+  if (cpuid::has (cpuid::PSE)) {
+    vm::enable_large_pages ();
+  }
+
+  // Select how to copy and clear pages.
+  page_copy::initialize ();
+
   // Tell the system allocator that it must allocate frames and map them.
   kernel_alloc::engage_vm (PAGING_AREA);
 
+  // The frame tables for memory above the boot limit can now be allocated.
+  frame_manager::add_deferred ();
+
   // Initialize the scheduler.
   scheduler::initialize ();
 
@@ -280,7 +313,7 @@ kmain (uint32_t multiboot_magic,
   {
     // Create a buffer containing the text of the initial automaton.
     const size_t automaton_frame_end = boot_automaton_frame + align_up (boot_automaton_size, PAGE_SIZE) / PAGE_SIZE;
-    shared_ptr<buffer> text = shared_ptr<buffer> (new buffer (0));
+    intrusive_ptr<buffer> text = intrusive_ptr<buffer> (new buffer (0));
     kassert (text.get () != 0);
     for (frame_t frame = boot_automaton_frame; frame != automaton_frame_end; ++frame) {
       text->append_frame (frame);
@@ -291,7 +324,7 @@ kmain (uint32_t multiboot_magic,
     
     // Create a buffer to contain the initial data.
     const size_t data_frame_end = boot_data_frame + align_up (boot_data_size, PAGE_SIZE) / PAGE_SIZE;
-    shared_ptr<buffer> data_buffer = shared_ptr<buffer> (new buffer (0));
+    intrusive_ptr<buffer> data_buffer = intrusive_ptr<buffer> (new buffer (0));
     kassert (data_buffer.get () != 0);
     for (frame_t frame = boot_data_frame; frame != data_frame_end; ++frame) {
       data_buffer->append_frame (frame);
@@ -301,7 +334,7 @@ kmain (uint32_t multiboot_magic,
     }
     
     // Create the automaton.
-    pair<shared_ptr<automaton>, int> r = automaton::create_automaton (true, text, boot_automaton_size);
+    pair<intrusive_ptr<automaton>, int> r = automaton::create_automaton (true, text, boot_automaton_size);
     
     if (r.first.get () == 0) {
       kout << "Could not create the boot automaton.  Halting." << endl;
@@ -0,0 +1,63 @@
+#ifndef LILY_IMAGE_H
+#define LILY_IMAGE_H
+
+/* Pre-linked Images
+   =================
+   A pre-linked image is an automaton whose ELF file has been converted by the prelink tool into a form the kernel can use without parsing.
+
+   The image consists of:
+   1.  A header.
+   2.  An array of segments.
+   3.  An array of pages.
+   4.  An array of actions.
+   5.  A string table containing the names and descriptions of the actions.
+   6.  The data pages starting at data_offset which is page-aligned.
+
+   Each segment refers to a contiguous run of entries in the page array, one for each page from the page containing begin to the page containing end - 1.
+   A page entry gives the data page to map or LILY_IMAGE_ZERO_PAGE for a page that is entirely zero.
+   The prelink tool resolves pages shared by segments and zeroes the uninitialized part of partial pages so the kernel maps the pages as they are.
+   Strings are null-terminated and interned so identical names and descriptions share an offset.
+   All fields are 32 bits wide.
+*/
+
+#define LILY_IMAGE_MAGIC "\177LLY"
+#define LILY_IMAGE_VERSION 1
+
+#define LILY_IMAGE_ZERO_PAGE 0xFFFFFFFF
+
+#define LILY_IMAGE_READ_ONLY 0
+#define LILY_IMAGE_COPY_ON_WRITE 1
+
+typedef struct {
+  char magic[4];
+  unsigned int version;
+  unsigned int segment_count;
+  unsigned int page_count;
+  unsigned int action_count;
+  unsigned int string_size;
+  unsigned int data_offset;
+} lily_image_header_t;
+
+typedef struct {
+  unsigned int begin;
+  unsigned int end;
+  unsigned int first_page;	/* Index of the first entry in the page array. */
+} lily_image_segment_t;
+
+typedef struct {
+  unsigned int data_page;	/* Page number relative to data_offset or LILY_IMAGE_ZERO_PAGE. */
+  unsigned int map_mode;	/* LILY_IMAGE_READ_ONLY or LILY_IMAGE_COPY_ON_WRITE. */
+} lily_image_page_t;
+
+typedef struct {
+  unsigned int type;
+  unsigned int parameter_mode;
+  unsigned int entry_point;
+  unsigned int number;
+  unsigned int name_offset;	/* Offset in the string table. */
+  unsigned int name_size;	/* Includes the null terminator. */
+  unsigned int description_offset;
+  unsigned int description_size;
+} lily_image_action_t;
+
+#endif /* LILY_IMAGE_H */
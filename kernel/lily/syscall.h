@@ -5,11 +5,13 @@
 #define LILY_SYSCALL_SCHEDULE              0x00
 #define LILY_SYSCALL_FINISH                0x01
 #define LILY_SYSCALL_EXIT                  0x02
+#define LILY_SYSCALL_FINISH_LIST           0x03
 
 #define LILY_SYSCALL_CREATE                0x10
 #define LILY_SYSCALL_BIND                  0x11
 #define LILY_SYSCALL_UNBIND                0x12
 #define LILY_SYSCALL_DESTROY               0x13
+#define LILY_SYSCALL_CLONE                 0x14
 
 #define LILY_SYSCALL_LOG                   0x20
 
@@ -25,12 +27,16 @@
 #define LILY_SYSCALL_BUFFER_APPEND         0x46
 #define LILY_SYSCALL_BUFFER_MAP            0x47
 #define LILY_SYSCALL_BUFFER_UNMAP          0x48
+#define LILY_SYSCALL_BUFFER_COPY_RANGE     0x49
+#define LILY_SYSCALL_BUFFER_APPEND_RANGE   0x4A
 
 #define LILY_SYSCALL_SYSCONF               0x50
 #define LILY_SYSCALL_DESCRIBE              0x51
 #define LILY_SYSCALL_GETAID                0x52
 #define LILY_SYSCALL_GETMONOTIME           0x53
 #define LILY_SYSCALL_GET_BOOT_DATA         0X54
+#define LILY_SYSCALL_GET_MEMORY_STATS      0x55
+#define LILY_SYSCALL_SET_MEMORY_QUOTA      0x56
 
 /* Privileged system calls. */
 #define LILY_SYSCALL_MAP                   0x100
@@ -48,6 +54,11 @@
 #define LILY_SYSCALL_SUBSCRIBE_IRQ         0x120
 #define LILY_SYSCALL_UNSUBSCRIBE_IRQ       0x121
 
+#define LILY_SYSCALL_PRINT_SLAB_STATISTICS 0x130
+
+/* Maximum number of buffer ranges for finish_list. */
+#define LILY_SYSCALL_FINISH_LIST_MAX 16
+
 /* Names for sysconf. */
 #define LILY_SYSCALL_SYSCONF_PAGESIZE 0
 
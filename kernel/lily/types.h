@@ -20,11 +20,33 @@ typedef struct {
   size_t description_size;
 } action_descriptor_t;
 
+/* A range of pages in a buffer.  Used to pass lists of buffers from an output to its inputs. */
+typedef struct {
+  bd_t bd;
+  size_t begin;
+  size_t end;
+} buffer_range_t;
+
 typedef struct {
   unsigned int seconds;
   unsigned int nanoseconds;
 } mono_time_t;
 
+/* Memory used by an automaton in pages. */
+typedef struct {
+  size_t heap;		/* Pages in the heap. */
+  size_t stack;		/* Pages in the stack. */
+  size_t buffers;	/* Pages in buffers.  A page shared by buffers is counted in each. */
+  size_t image;		/* Pages of the text that have been mapped. */
+  size_t page_tables;	/* Page tables for user space and the page directory. */
+  size_t quota;		/* Limit on heap + stack + buffers or MEMORY_QUOTA_NONE. */
+  size_t free;		/* Free frames in the system. */
+  size_t copy_on_write_faults;	/* Copy-on-write faults taken by the automaton. */
+  size_t copy_on_write_pages;	/* Pages resolved by those faults including fault-around. */
+} memory_stats_t;
+
+#define MEMORY_QUOTA_NONE ((size_t)-1)
+
 /* Error codes. */
 typedef enum {
   LILY_ERROR_SUCCESS,
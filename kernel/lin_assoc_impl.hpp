@@ -271,7 +271,9 @@ public:
   iterator
   find (const key_type& key)
   {
-    bucket_type* bucket = find_ (key);
+    size_t hash;
+    size_type lookup_key;
+    bucket_type* bucket = find_ (key, &hash, &lookup_key);
     if (bucket != 0) {
       return iterator (this, bucket);
     }
@@ -283,7 +285,9 @@ public:
   const_iterator
   find (const key_type& key) const
   {
-    bucket_type* bucket = find_ (key);
+    size_t hash;
+    size_type lookup_key;
+    bucket_type* bucket = find_ (key, &hash, &lookup_key);
     if (bucket != 0) {
       return const_iterator (this, bucket);
     }
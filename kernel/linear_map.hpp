@@ -1,6 +1,7 @@
 #ifndef __linear_map_hpp__
 #define __linear_map_hpp__
 
+#include "slab_allocator.hpp"
 #include "lin_assoc_impl.hpp"
 
 template <typename Key,
@@ -17,7 +18,7 @@ template <typename Key,
 	  typename T,
 	  typename Hash = hash<Key>,
 	  typename Equal = equal_to<Key>,
-	  typename Allocator = allocator<pair<const Key, T> > >
+	  typename Allocator = slab_allocator<pair<const Key, T> > >
 class linear_map : public lin_assoc_cont<Key, pair<const Key, T>, first_selector<const Key, T>, Hash, Equal, Allocator> {
 private:
   typedef lin_assoc_cont<Key, pair<const Key, T>, first_selector<const Key, T>, Hash, Equal, Allocator> impl_type;
@@ -1,13 +1,14 @@
 #ifndef __linear_set_hpp__
 #define __linear_set_hpp__
 
+#include "slab_allocator.hpp"
 #include "lin_assoc_impl.hpp"
 #include "identity_selector.hpp"
 
 template <typename T,
 	  typename Hash = hash<T>,
 	  typename Equal = equal_to<T>,
-	  typename Allocator = allocator<T> >
+	  typename Allocator = slab_allocator<T> >
 class linear_set : public lin_assoc_cont<T, T, identity_selector<T>, Hash, Equal, Allocator> {
 private:
   typedef lin_assoc_cont<T, T, identity_selector<T>, Hash, Equal, Allocator> impl_type;
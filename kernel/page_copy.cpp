@@ -0,0 +1,104 @@
+/*
+  File
+  ----
+  page_copy.cpp
+  
+  Description
+  -----------
+  Copy and clear whole pages.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+#include "page_copy.hpp"
+#include "cpuid.hpp"
+#include "vm_def.hpp"
+#include "kassert.hpp"
+
+namespace page_copy {
+
+  static void
+  copy_string (void* dst,
+	       const void* src)
+  {
+    size_t count = PAGE_SIZE / sizeof (uint32_t);
+    asm volatile ("cld\n"
+		  "rep movsl\n" : "+D"(dst), "+S"(src), "+c"(count) : : "memory");
+  }
+
+  static void
+  clear_string (void* dst)
+  {
+    size_t count = PAGE_SIZE / sizeof (uint32_t);
+    asm volatile ("cld\n"
+		  "rep stosl\n" : "+D"(dst), "+c"(count) : "a"(0) : "memory");
+  }
+
+  // Each iteration moves 16 bytes.
+  static void
+  copy_nontemporal (void* dst,
+		    const void* src)
+  {
+    size_t count = PAGE_SIZE / 16;
+    asm volatile ("1:\n"
+		  "mov (%1), %%eax\n"
+		  "mov 4(%1), %%edx\n"
+		  "movnti %%eax, (%0)\n"
+		  "movnti %%edx, 4(%0)\n"
+		  "mov 8(%1), %%eax\n"
+		  "mov 12(%1), %%edx\n"
+		  "movnti %%eax, 8(%0)\n"
+		  "movnti %%edx, 12(%0)\n"
+		  "add $16, %1\n"
+		  "add $16, %0\n"
+		  "dec %2\n"
+		  "jnz 1b\n"
+		  "sfence\n" : "+r"(dst), "+r"(src), "+r"(count) : : "eax", "edx", "memory");
+  }
+
+  static void
+  clear_nontemporal (void* dst)
+  {
+    size_t count = PAGE_SIZE / 16;
+    asm volatile ("xor %%eax, %%eax\n"
+		  "1:\n"
+		  "movnti %%eax, (%0)\n"
+		  "movnti %%eax, 4(%0)\n"
+		  "movnti %%eax, 8(%0)\n"
+		  "movnti %%eax, 12(%0)\n"
+		  "add $16, %0\n"
+		  "dec %1\n"
+		  "jnz 1b\n"
+		  "sfence\n" : "+r"(dst), "+r"(count) : : "eax", "memory");
+  }
+
+  static void (*copy_func) (void*, const void*) = copy_string;
+  static void (*clear_func) (void*) = clear_string;
+
+  void
+  initialize ()
+  {
+    if (cpuid::has (cpuid::SSE2)) {
+      copy_func = copy_nontemporal;
+      clear_func = clear_nontemporal;
+    }
+  }
+
+  void
+  copy (void* dst,
+	const void* src)
+  {
+    kassert (is_aligned (reinterpret_cast<logical_address_t> (dst), PAGE_SIZE));
+    kassert (is_aligned (reinterpret_cast<logical_address_t> (src), PAGE_SIZE));
+    copy_func (dst, src);
+  }
+
+  void
+  clear (void* dst)
+  {
+    kassert (is_aligned (reinterpret_cast<logical_address_t> (dst), PAGE_SIZE));
+    clear_func (dst);
+  }
+
+}
@@ -0,0 +1,43 @@
+#ifndef __page_copy_hpp__
+#define __page_copy_hpp__
+
+/*
+  File
+  ----
+  page_copy.hpp
+  
+  Description
+  -----------
+  Copy and clear whole pages.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+/*
+  Copy-on-write faults and zero-filled frames copy or clear an entire page.
+  The general purpose memcpy and memset move one byte at a time.
+  These routines move a page-aligned page using string instructions.
+  If the processor supports SSE2, they use non-temporal stores (movnti) so that a page copied for another automaton does not evict the cache.
+  The non-temporal variants use general purpose registers so the kernel does not need to save the SSE state of the automaton.
+  The variant is selected once when the kernel starts.
+*/
+
+namespace page_copy {
+
+  // Select the fastest variant supported by the processor.
+  void
+  initialize ();
+
+  // Copy the page at src to the page at dst.  Both must be page-aligned.
+  void
+  copy (void* dst,
+	const void* src);
+
+  // Fill the page at dst with zeroes.  The page must be page-aligned.
+  void
+  clear (void* dst);
+
+}
+
+#endif /* __page_copy_hpp__ */
@@ -0,0 +1,161 @@
+#ifndef __prelinked_hpp__
+#define __prelinked_hpp__
+
+/*
+  File
+  ----
+  prelinked.hpp
+
+  Description
+  -----------
+  Load pre-linked automaton images.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+#include <lily/image.h>
+#include "buffer_file.hpp"
+#include "kstring.hpp"
+#include "elf_image.hpp"
+
+// The prelink tool has already laid out the pages of each segment and collected the actions so loading a pre-linked image only validates the tables and records them in the image.
+// See lily/image.h for the format.
+namespace prelinked {
+
+  // Returns true if the region of memory starts with the magic number of a pre-linked image.
+  inline bool
+  is_prelinked (logical_address_t begin,
+		logical_address_t end)
+  {
+    return end - begin >= sizeof (lily_image_header_t) && memcmp (reinterpret_cast<const void*> (begin), LILY_IMAGE_MAGIC, 4) == 0;
+  }
+
+  // Interpret a region of memory as a pre-linked image and record the result in an image.
+  inline int
+  parse (elf_image& image,
+	 logical_address_t begin,
+	 logical_address_t end)
+  {
+    buffer_file bf (begin, end);
+    const size_t size = end - begin;
+
+    const lily_image_header_t* const header = static_cast<const lily_image_header_t*> (bf.readp (sizeof (lily_image_header_t)));
+    if (header == 0) {
+      return -1;
+    }
+
+    if (memcmp (header->magic, LILY_IMAGE_MAGIC, 4) != 0) {
+      return -1;
+    }
+
+    if (header->version != LILY_IMAGE_VERSION) {
+      // Unknown version.
+      return -1;
+    }
+
+    // The counts come from the image so check them before multiplying.
+    if (header->segment_count > size / sizeof (lily_image_segment_t) ||
+	header->page_count > size / sizeof (lily_image_page_t) ||
+	header->action_count > size / sizeof (lily_image_action_t)) {
+      return -1;
+    }
+
+    const lily_image_segment_t* const segments = static_cast<const lily_image_segment_t*> (bf.readp (header->segment_count * sizeof (lily_image_segment_t)));
+    const lily_image_page_t* const pages = static_cast<const lily_image_page_t*> (bf.readp (header->page_count * sizeof (lily_image_page_t)));
+    const lily_image_action_t* const actions = static_cast<const lily_image_action_t*> (bf.readp (header->action_count * sizeof (lily_image_action_t)));
+    const char* const strings = static_cast<const char*> (bf.readp (header->string_size));
+    if (segments == 0 || pages == 0 || actions == 0 || strings == 0) {
+      return -1;
+    }
+
+    if (!is_aligned (header->data_offset, PAGE_SIZE) || header->data_offset < bf.position () || header->data_offset > size) {
+      return -1;
+    }
+    const size_t data_page_count = align_up (size - header->data_offset, PAGE_SIZE) / PAGE_SIZE;
+
+    for (size_t idx = 0; idx != header->segment_count; ++idx) {
+      const lily_image_segment_t& s = segments[idx];
+      if (s.begin >= s.end || s.end > KERNEL_VIRTUAL_BASE) {
+	return -1;
+      }
+
+      const size_t page_count = (align_up (s.end, PAGE_SIZE) - align_down (s.begin, PAGE_SIZE)) / PAGE_SIZE;
+      if (s.first_page > header->page_count || page_count > header->page_count - s.first_page) {
+	return -1;
+      }
+
+      // Conflicts between segments are detected when instantiating the image.
+      image.segments.push_back (elf_image::segment (s.begin, s.end));
+      elf_image::segment::page_list_type& list = image.segments.back ().pages;
+      for (size_t p = s.first_page; p != s.first_page + page_count; ++p) {
+	frame_t frame;
+	if (pages[p].data_page == LILY_IMAGE_ZERO_PAGE) {
+	  frame = vm::zero_frame ();
+	}
+	else if (pages[p].data_page < data_page_count) {
+	  frame = vm::logical_address_to_frame (begin + header->data_offset + pages[p].data_page * PAGE_SIZE);
+	}
+	else {
+	  return -1;
+	}
+
+	switch (pages[p].map_mode) {
+	case LILY_IMAGE_READ_ONLY:
+	  list.push_back (make_pair (frame, vm::MAP_READ_ONLY));
+	  break;
+	case LILY_IMAGE_COPY_ON_WRITE:
+	  list.push_back (make_pair (frame, vm::MAP_COPY_ON_WRITE));
+	  break;
+	default:
+	  return -1;
+	}
+      }
+    }
+
+    for (size_t idx = 0; idx != header->action_count; ++idx) {
+      const lily_image_action_t& a = actions[idx];
+
+      switch (a.type) {
+      case INPUT:
+      case OUTPUT:
+      case INTERNAL:
+      case SYSTEM:
+	break;
+      default:
+	// Unknown action type.
+	return -1;
+      }
+
+      switch (a.parameter_mode) {
+      case NO_PARAMETER:
+      case PARAMETER:
+      case AUTO_PARAMETER:
+	break;
+      default:
+	// Unknown parameter mode.
+	return -1;
+      }
+
+      if (static_cast<ano_t> (a.number) < 0) {
+	// Negative action number.
+	return -1;
+      }
+
+      if (a.name_size == 0 || a.name_offset > header->string_size || a.name_size > header->string_size - a.name_offset || strings[a.name_offset + a.name_size - 1] != 0) {
+	return -1;
+      }
+
+      if (a.description_size == 0 || a.description_offset > header->string_size || a.description_size > header->string_size - a.description_offset || strings[a.description_offset + a.description_size - 1] != 0) {
+	return -1;
+      }
+
+      // Conflicts between actions are detected when instantiating the image.
+      image.add_action (new paction (static_cast<action_type_t> (a.type), static_cast<parameter_mode_t> (a.parameter_mode), reinterpret_cast<const void*> (a.entry_point), a.number, kstring (strings + a.name_offset, a.name_size), kstring (strings + a.description_offset, a.description_size)));
+    }
+
+    return 0;
+  }
+}
+
+#endif /* __prelinked_hpp__ */
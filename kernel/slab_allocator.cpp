@@ -0,0 +1,48 @@
+/*
+  File
+  ----
+  slab_allocator.cpp
+  
+  Description
+  -----------
+  Caches of fixed-size kernel objects.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+#include "slab_allocator.hpp"
+#include "kernel_alloc.hpp"
+#include "kout.hpp"
+
+void
+slab_cache::grow ()
+{
+  char* slab = static_cast<char*> (kernel_alloc::alloc (SLAB_SIZE));
+  kassert (slab != 0);
+
+  if (slab_count == 0) {
+    // First slab.  Make the cache visible to print_statistics.
+    next = cache_list;
+    cache_list = this;
+  }
+  ++slab_count;
+
+  // Thread the objects onto the free list.
+  for (size_t offset = 0; offset + object_size <= SLAB_SIZE; offset += object_size) {
+    free_object* obj = reinterpret_cast<free_object*> (slab + offset);
+    obj->next = free_list;
+    free_list = obj;
+  }
+}
+
+void
+slab_cache::print_statistics ()
+{
+  kout << "object_size slabs bytes allocations live" << endl;
+  for (slab_cache* c = cache_list; c != 0; c = c->next) {
+    kout << c->object_size << " " << c->slab_count << " " << c->bytes () << " " << c->alloc_count << " " << c->live_count << endl;
+  }
+}
+
+slab_cache* slab_cache::cache_list = 0;
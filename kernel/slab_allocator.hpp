@@ -0,0 +1,185 @@
+#ifndef __slab_allocator_hpp__
+#define __slab_allocator_hpp__
+
+/*
+  File
+  ----
+  slab_allocator.hpp
+  
+  Description
+  -----------
+  Caches of fixed-size kernel objects.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+#include "vm_def.hpp"
+#include "memory.hpp"
+
+/*
+  Objects that are created and destroyed for every message, e.g., reference counts, buffers, and hash buckets, are small and have a fixed size.
+  Allocating them with kernel_alloc costs a bin search, a header, and a footer per object.
+  A slab cache carves objects of one size out of slabs allocated from kernel_alloc.
+  Free objects are kept on a LIFO list so allocation and deallocation are a few instructions and the most recently freed object, which is likely to be in the cache, is reused first.
+  Slabs are never returned to kernel_alloc.
+
+  There is one cache per type.
+  Caches are plain data initialized with constants so they can be used before the static constructors run.
+  Each cache counts its allocations so the memory consumed by each type can be observed.
+*/
+
+struct slab_cache {
+  static const size_t SLAB_SIZE = PAGE_SIZE;
+
+  struct free_object {
+    free_object* next;
+  };
+
+  // Size of an object rounded up to hold a free object.
+  size_t object_size;
+  // Free objects.
+  free_object* free_list;
+  // Number of slabs allocated.
+  size_t slab_count;
+  // Number of allocations since boot.
+  size_t alloc_count;
+  // Number of objects currently allocated.
+  size_t live_count;
+  // Caches that have allocated a slab.
+  slab_cache* next;
+
+  static slab_cache* cache_list;
+
+  inline void*
+  alloc ()
+  {
+    if (free_list == 0) {
+      grow ();
+    }
+
+    free_object* obj = free_list;
+    free_list = obj->next;
+    ++alloc_count;
+    ++live_count;
+    return obj;
+  }
+
+  inline void
+  free (void* ptr)
+  {
+    free_object* obj = static_cast<free_object*> (ptr);
+    obj->next = free_list;
+    free_list = obj;
+    --live_count;
+  }
+
+  // Bytes of slab memory held by the cache.
+  inline size_t
+  bytes () const
+  {
+    return slab_count * SLAB_SIZE;
+  }
+
+  // Print the statistics for all caches.
+  static void
+  print_statistics ();
+
+private:
+  void
+  grow ();
+};
+
+// Objects must be large enough to hold a free object and aligned for a pointer.
+template <size_t SIZE>
+struct slab_object_size {
+  static const size_t value = (SIZE < sizeof (slab_cache::free_object)) ? sizeof (slab_cache::free_object) : (SIZE + sizeof (void*) - 1) & ~(sizeof (void*) - 1);
+};
+
+/*
+  An allocator that allocates single objects from the slab cache for T.
+  Arrays, e.g., the lookup tables of the hashed containers, are allocated with operator new.
+*/
+template <typename T>
+class slab_allocator {
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef T& reference;
+  typedef const T* const_pointer;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  slab_allocator () { }
+  slab_allocator (const slab_allocator&) { }
+  template <typename U>
+  slab_allocator (const slab_allocator<U>&) { }
+  ~slab_allocator () { }
+
+  static inline pointer
+  address (reference x)
+  {
+    return &x;
+  }
+
+  static inline const_pointer
+  address (const_reference x)
+  {
+    return &x;
+  }
+  
+  static inline pointer
+  allocate (size_type n,
+	    const void* = 0)
+  {
+    if (n == 1) {
+      return static_cast<pointer> (cache_.alloc ());
+    }
+    return static_cast<pointer> (::operator new (n * sizeof (T)));
+  }
+
+  static inline void
+  deallocate (pointer p,
+	      size_type n)
+  {
+    if (n == 1) {
+      cache_.free (p);
+    }
+    else {
+      ::operator delete (p);
+    }
+  }
+
+  static inline size_type
+  max_size ()
+  {
+    return size_type (-1) / sizeof (T);
+  }
+
+  static void
+  construct (pointer p,
+	     const_reference val)
+  {
+    new (p) T (val);
+  }
+
+  static void
+  destroy (pointer p)
+  {
+    p->~T ();
+  }
+
+  template <typename U>
+  struct rebind {
+    typedef slab_allocator<U> other;
+  };
+
+private:
+  static slab_cache cache_;
+};
+
+template <typename T>
+slab_cache slab_allocator<T>::cache_ = { slab_object_size<sizeof (T)>::value, 0, 0, 0, 0, 0 };
+
+#endif /* __slab_allocator_hpp__ */
@@ -17,26 +17,42 @@ stack_allocator::stack_allocator (frame_t begin,
 				  frame_t end) :
   begin_ (begin),
   end_ (end),
-  free_head_ (0)
+  free_head_ (STACK_ALLOCATOR_EOL)
 {
   kassert (begin < end);
+  kassert ((end - begin) * PAGE_SIZE <= MAX_REGION_SIZE);
   
-  const frame_entry_t size = end - begin;
+  const size_t size = end - begin;
   entry_  = new frame_entry_t[size];
-  for (frame_entry_t k = 0; k < size; ++k) {
-    entry_[k] = k + 1;
+  for (size_t k = 0; k != size; ++k) {
+    entry_[k] = -1;
   }
-  entry_[size - 1] = STACK_ALLOCATOR_EOL;
 }
 
 void
+stack_allocator::release (frame_t begin,
+			  frame_t end)
+{
+  kassert (begin >= begin_ && end <= end_ && begin <= end);
+
+  // Push in reverse order so that low frames are allocated first.
+  while (end != begin) {
+    --end;
+    frame_entry_t idx = end - begin_;
+    kassert (entry_[idx] == -1);
+    entry_[idx] = free_head_;
+    free_head_ = idx;
+  }
+}
+
+bool
 stack_allocator::mark_as_used (frame_t frame)
 {
   kassert (frame >= begin_ && frame < end_);
   
   frame_entry_t frame_idx = frame - begin_;
   // Is the frame free?
-  if (entry_[frame_idx] >= 0 && entry_[frame_idx] != STACK_ALLOCATOR_EOL) {
+  if (entry_[frame_idx] >= 0 || entry_[frame_idx] == STACK_ALLOCATOR_EOL) {
     /* Find the one that points to it. */
     if (free_head_ != frame_idx) {
       int idx;
@@ -49,5 +65,8 @@ stack_allocator::mark_as_used (frame_t frame)
       free_head_ = entry_[frame_idx];
     }
     entry_[frame_idx] = -1;
+    return true;
   }
+
+  return false;
 }
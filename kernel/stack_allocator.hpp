@@ -35,7 +35,16 @@
   With 31-bit entries, a frame can be shared 2,147,483,647 times.
   With 15-bit entries, a frame can be shared 32,767 times.
 
-  Share a page 32,767 times seems reasonable so I will use the more space-efficient 15-bit entries.
+  Originally, I used 15-bit entries since sharing a page 32,767 times seemed reasonable.
+  However, a single buffer can map the same frame many times, e.g., copy-on-write copies of a buffer, so 15 bits is too easy to overflow.
+  Regions are now limited to 4MB by the frame manager so the table for a region is 4KB with 31-bit entries.
+  Thus, I use 31-bit entries.
+  The tables for 4GB take 4MB which does not fit in the initial kernel heap so the frame manager only allocates the tables for the first 1GB during boot.
+  The other tables are allocated after the heap is backed by frames.
+
+  With PAE, the goal is 64GB of memory, i.e., 16,777,216 frames and 64MB of entries.
+  Tables are only allocated for regions that contain memory so the cost is proportional to the memory installed.
+  Like the tables above 1GB, the tables above 4GB are allocated after boot and come out of the kernel's logical address space (just under 1GB) which comfortably holds 64MB.
 */
 
 class kernel_alloc;
@@ -44,9 +53,15 @@ class stack_allocator {
 public:
   static const size_t MAX_REGION_SIZE = 0x07FFF000;
 
+  // Initially, all of the frames are used.
   stack_allocator (frame_t begin,
 		   frame_t end);
 
+  // Make the frames [begin, end) available for allocation.
+  void
+  release (frame_t begin,
+	   frame_t end);
+
   inline frame_t
   begin () const
   {
@@ -64,8 +79,9 @@ public:
   {
     return free_head_ == STACK_ALLOCATOR_EOL;
   }
-  
-  void
+
+  // Returns true if the frame was free.
+  bool
   mark_as_used (frame_t frame);
 
   inline frame_t
@@ -118,8 +134,8 @@ public:
   }
 
 private:
-  typedef int16_t frame_entry_t;
-  static const frame_entry_t STACK_ALLOCATOR_EOL = -32768;
+  typedef int32_t frame_entry_t;
+  static const frame_entry_t STACK_ALLOCATOR_EOL = (-2147483647 - 1);
 
   frame_t begin_;
   frame_t end_;
@@ -48,7 +48,7 @@ trap_dispatch (volatile registers regs)
 {
   kassert (regs.number == SYSCALL_INTERRUPT);
 
-  const shared_ptr<automaton>& a = scheduler::current_automaton ();
+  const intrusive_ptr<automaton>& a = scheduler::current_automaton ();
 
   /* These match the order in lily/syscall.h.
      Please keep it that way.
@@ -68,6 +68,21 @@ trap_dispatch (volatile registers regs)
       return;
     }
     break;
+  case LILY_SYSCALL_FINISH_LIST:
+    {
+      const buffer_range_t* ranges = reinterpret_cast<const buffer_range_t*> (regs.ecx);
+      const size_t count = regs.edx;
+      if (count > LILY_SYSCALL_FINISH_LIST_MAX ||
+	  (count != 0 && !a->verify_span (ranges, count * sizeof (buffer_range_t)))) {
+	// Bad list.  Treat the output as not firing.
+	scheduler::finish (false, -1, -1);
+      }
+      else {
+	scheduler::finish (regs.ebx, ranges, count);
+      }
+      return;
+    }
+    break;
   case LILY_SYSCALL_EXIT:
     {
       a->exit (a, regs.ebx);
@@ -82,6 +97,14 @@ trap_dispatch (volatile registers regs)
       return;
     }
     break;
+  case LILY_SYSCALL_CLONE:
+    {
+      pair<aid_t, lily_error_t> r = a->clone (scheduler::current_action (), regs.ebx, regs.ecx);
+      regs.eax = r.first;
+      regs.ecx = r.second;
+      return;
+    }
+    break;
   case LILY_SYSCALL_BIND:
     {
       bind_args* ptr = reinterpret_cast<bind_args*> (regs.ebx);
@@ -198,6 +221,22 @@ trap_dispatch (volatile registers regs)
       return;
     }
     break;
+  case LILY_SYSCALL_BUFFER_COPY_RANGE:
+    {
+      pair<bd_t, lily_error_t> r = a->buffer_copy (regs.ebx, regs.ecx, regs.edx);
+      regs.eax = r.first;
+      regs.ecx = r.second;
+      return;
+    }
+    break;
+  case LILY_SYSCALL_BUFFER_APPEND_RANGE:
+    {
+      pair<size_t, lily_error_t> r = a->buffer_append (regs.ebx, regs.ecx, regs.edx, regs.esi);
+      regs.eax = r.first;
+      regs.ecx = r.second;
+      return;
+    }
+    break;
   case LILY_SYSCALL_SYSCONF:
     {
       switch (regs.ebx) {
@@ -245,6 +284,20 @@ trap_dispatch (volatile registers regs)
       regs.ecx = r.second;
     }
     break;
+  case LILY_SYSCALL_GET_MEMORY_STATS:
+    {
+      pair<int, lily_error_t> r = a->get_memory_stats (regs.ebx, reinterpret_cast<memory_stats_t*> (regs.ecx));
+      regs.eax = r.first;
+      regs.ecx = r.second;
+    }
+    break;
+  case LILY_SYSCALL_SET_MEMORY_QUOTA:
+    {
+      pair<int, lily_error_t> r = a->set_memory_quota (regs.ebx, regs.ecx);
+      regs.eax = r.first;
+      regs.ecx = r.second;
+    }
+    break;
   case LILY_SYSCALL_MAP:
     {
       pair<int, lily_error_t> r = a->map (reinterpret_cast<const void*> (regs.ebx), reinterpret_cast<const void*> (regs.ecx), regs.edx);
@@ -341,6 +394,14 @@ trap_dispatch (volatile registers regs)
       return;
     }
     break;
+  case LILY_SYSCALL_PRINT_SLAB_STATISTICS:
+    {
+      pair<int, lily_error_t> r = a->print_slab_statistics ();
+      regs.eax = r.first;
+      regs.ecx = r.second;
+      return;
+    }
+    break;
   default:
     kpanic ("TODO:  Unknown system call");
     break;
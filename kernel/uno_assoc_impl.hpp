@@ -6,12 +6,19 @@
 #include "functional.hpp"
 #include "utility.hpp"
 
-template <typename Value>
-struct uno_assoc_bucket {
-  Value value;
-  size_t hash;
-  uno_assoc_bucket* next;
-};
+/*
+  The container is an open-addressing hash table.
+  Values are stored in an array of slots and probed linearly so a lookup touches consecutive memory and inserting does not allocate a node.
+  Each slot has a control byte that is EMPTY, DELETED, or 7 bits of the hash of the value in the slot.
+  Probing compares control bytes and only compares keys when the 7 bits match.
+  Erasing leaves a DELETED marker so that probe sequences are not broken and no other value moves.
+  Thus, erasing does not invalidate iterators to other values.
+
+  When the table becomes too full, a new table is allocated but values are moved incrementally.
+  Each insert moves a few slots from the old table to the new table so that no single insert pays for the entire rehash.
+  Lookups search the new table and then the old table until the old table is empty.
+  Like the standard containers, inserting invalidates iterators.
+*/
 
 template <typename Key,
 	  typename Value,
@@ -19,16 +26,12 @@ template <typename Key,
 	  typename Hash,
 	  typename Equal,
 	  typename Allocator>
-class uno_assoc_cont : public Allocator::template rebind<uno_assoc_bucket<Value> >::other,
-		       public Allocator::template rebind<uno_assoc_bucket<Value*> >::other,
-		       public Selector,
+class uno_assoc_cont : public Selector,
 		       public Hash,
 		       public Equal {
 private:
   typedef uno_assoc_cont<Key, Value, Selector, Hash, Equal, Allocator> cont_type;
-  typedef uno_assoc_bucket<Value> bucket_type;
-  typedef typename Allocator::template rebind<bucket_type>::other bucket_allocator;
-  typedef typename Allocator::template rebind<bucket_type*>::other lookup_allocator;
+  typedef typename Allocator::template rebind<unsigned char>::other control_allocator;
 
 public:
   typedef Allocator allocator_type;
@@ -43,98 +46,131 @@ public:
   typedef typename Allocator::size_type size_type;
   typedef typename Allocator::difference_type difference_type;
 
+private:
+  static const unsigned char EMPTY = 0x80;
+  static const unsigned char DELETED = 0xFE;
+  // Control bytes for full slots have the high bit clear.
+  static const unsigned char FULL_MASK = 0x7F;
+
+  static const size_type MIN_CAPACITY = 8;
+  // Number of old slots moved by each insert during an incremental rehash.
+  static const size_type MIGRATE_STEP = 8;
+
+  struct table {
+    unsigned char* control;
+    pointer slots;
+    // Always a power of two.
+    size_type capacity;
+    // Number of full slots.
+    size_type size;
+    // Number of full and deleted slots.
+    size_type used;
+  };
+
+  // The index of the old table.  The current table has index 0.
+  static const int OLD = 1;
+
+  table tables_[2];
+  // True if values are being moved from tables_[OLD] to tables_[0].
+  bool migrating_;
+  // The next slot of the old table to move.
+  size_type migrate_idx_;
+
+public:
   struct local_iterator { };
   struct const_local_iterator { };
 
   struct iterator {
     const cont_type* map_;
-    bucket_type* bucket_;
+    int table_;
+    size_type idx_;
 
     iterator (const cont_type* map,
-	      bucket_type* bucket) :
+	      int t,
+	      size_type idx) :
       map_ (map),
-      bucket_ (bucket)
+      table_ (t),
+      idx_ (idx)
     { }
-    
+
     bool
     operator== (const iterator& other) const
     {
-      return bucket_ == other.bucket_;
+      return table_ == other.table_ && idx_ == other.idx_;
     }
 
     bool
     operator!= (const iterator& other) const
     {
-      return bucket_ != other.bucket_;
+      return !(*this == other);
     }
 
     pointer
     operator-> () const
     {
-      return &bucket_->value;
+      return &map_->tables_[table_].slots[idx_];
     }
 
     const_reference
     operator* () const
     {
-      return bucket_->value;
+      return map_->tables_[table_].slots[idx_];
     }
   };
 
   struct const_iterator {
     const cont_type* map_;
-    const bucket_type* bucket_;
+    int table_;
+    size_type idx_;
 
     const_iterator () :
       map_ (0),
-      bucket_ (0)
+      table_ (-1),
+      idx_ (0)
     { }
 
     const_iterator (const cont_type* map,
-  		    const bucket_type* bucket) :
+		    int t,
+		    size_type idx) :
       map_ (map),
-      bucket_ (bucket)
+      table_ (t),
+      idx_ (idx)
     { }
 
     const_iterator (const iterator& iter) :
       map_ (iter.map_),
-      bucket_ (iter.bucket_)
+      table_ (iter.table_),
+      idx_ (iter.idx_)
     { }
-    
+
     bool
     operator== (const const_iterator& other) const
     {
-      return bucket_ == other.bucket_;
+      return table_ == other.table_ && idx_ == other.idx_;
     }
 
     bool
     operator!= (const const_iterator& other) const
     {
-      return bucket_ != other.bucket_;
+      return !(*this == other);
     }
 
     const_pointer
     operator-> () const
     {
-      return &bucket_->value;
+      return &map_->tables_[table_].slots[idx_];
     }
 
     const_reference
     operator* () const
     {
-      return bucket_->value;
+      return map_->tables_[table_].slots[idx_];
     }
 
     const_iterator&
     operator++ ()
     {
-      size_type lookup_idx = (bucket_->hash % map_->lookup_size_) + 1;
-      bucket_ = bucket_->next;
-
-      for (; bucket_ == 0 && lookup_idx != map_->lookup_size_; ++lookup_idx) {
-	bucket_ = map_->lookup_[lookup_idx];
-      }
-
+      map_->next_full (table_, ++idx_);
       return *this;
     }
 
@@ -142,14 +178,7 @@ public:
     operator++ (int)
     {
       const_iterator retval = *this;
-
-      size_type lookup_idx = (bucket_->hash % map_->lookup_size_) + 1;
-      bucket_ = bucket_->next;
-
-      for (; bucket_ == 0 && lookup_idx != map_->lookup_size_; ++lookup_idx) {
-	bucket_ = map_->lookup_[lookup_idx];
-      }
-
+      ++*this;
       return retval;
     }
   };
@@ -158,127 +187,296 @@ public:
   typedef Equal key_equal;
 
 private:
+  static inline bool
+  is_full (unsigned char c)
+  {
+    return (c & EMPTY) == 0;
+  }
 
-  bucket_type** lookup_;
-  size_type lookup_size_;
-  size_type size_;
+  static inline unsigned char
+  control_for (size_t hash)
+  {
+    return (hash ^ (hash >> 7) ^ (hash >> 14) ^ (hash >> 21)) & FULL_MASK;
+  }
 
+  // Hashes of pointers and small integers have regular low bits so mix them before choosing the first slot.
+  static inline size_type
+  home (size_t hash,
+	size_type mask)
+  {
+    const size_t h = hash * 2654435761U;
+    return (h ^ (h >> 16)) & mask;
+  }
 
-public:
-  uno_assoc_cont ()
+  static inline void
+  create_table (table& t,
+		size_type capacity)
   {
-    lookup_ = lookup_allocator::allocate (2);
-    lookup_size_ = 2;
-    size_ = 0;
-    for (size_type idx = 0; idx != lookup_size_; ++idx) {
-      lookup_[idx] = 0;
+    t.control = control_allocator::allocate (capacity);
+    t.slots = Allocator::allocate (capacity);
+    t.capacity = capacity;
+    t.size = 0;
+    t.used = 0;
+    for (size_type idx = 0; idx != capacity; ++idx) {
+      t.control[idx] = EMPTY;
     }
   }
 
-  uno_assoc_cont (const uno_assoc_cont& other) :
-    bucket_allocator (other),
-    Allocator::template rebind<uno_assoc_bucket<Value*> >::other (other)
+  static inline void
+  clear_table (table& t)
   {
-    lookup_ = lookup_allocator::allocate (other.lookup_size_);
-    lookup_size_ = other.lookup_size_;
-    size_ = other.size_;
-    for (size_type idx = 0; idx != lookup_size_; ++idx) {
-      lookup_[idx] = 0;
-
-      for (bucket_type* ptr = other.lookup_[idx]; ptr != 0; ptr = ptr->next) {
-	bucket_type* bucket = bucket_allocator::allocate (1);
-	Allocator::construct (&bucket->value, ptr->value);
-	bucket->hash = ptr->hash;
-	bucket->next = lookup_[idx];
-	lookup_[idx] = bucket;
+    for (size_type idx = 0; idx != t.capacity; ++idx) {
+      if (is_full (t.control[idx])) {
+	Allocator::destroy (&t.slots[idx]);
       }
+      t.control[idx] = EMPTY;
+    }
+    t.size = 0;
+    t.used = 0;
+  }
+
+  static inline void
+  destroy_table (table& t)
+  {
+    clear_table (t);
+    control_allocator::deallocate (t.control, t.capacity);
+    Allocator::deallocate (t.slots, t.capacity);
+    t.control = 0;
+    t.slots = 0;
+    t.capacity = 0;
+  }
+
+  // Returns the slot containing key or capacity if not found.
+  inline size_type
+  find_in_table (const table& t,
+		 const key_type& key,
+		 size_t hash) const
+  {
+    const unsigned char c = control_for (hash);
+    const size_type mask = t.capacity - 1;
+    for (size_type idx = home (hash, mask), count = 0; count != t.capacity; idx = (idx + 1) & mask, ++count) {
+      if (t.control[idx] == EMPTY) {
+	break;
+      }
+      if (t.control[idx] == c && Equal::operator() (Selector::operator () (t.slots[idx]), key)) {
+	return idx;
+      }
+    }
+    return t.capacity;
+  }
+
+  // Place a value known not to be in the table.
+  static inline size_type
+  place (table& t,
+	 const value_type& value,
+	 size_t hash)
+  {
+    const size_type mask = t.capacity - 1;
+    size_type idx = home (hash, mask);
+    while (is_full (t.control[idx])) {
+      idx = (idx + 1) & mask;
+    }
+    if (t.control[idx] == EMPTY) {
+      ++t.used;
+    }
+    t.control[idx] = control_for (hash);
+    Allocator::construct (&t.slots[idx], value);
+    ++t.size;
+    return idx;
+  }
+
+  static inline void
+  remove (table& t,
+	  size_type idx)
+  {
+    Allocator::destroy (&t.slots[idx]);
+    t.control[idx] = DELETED;
+    --t.size;
+  }
+
+  // Advance idx to the next full slot, moving from the current table to the old table.
+  inline void
+  next_full (int& t,
+	     size_type& idx) const
+  {
+    for (;;) {
+      const table& tab = tables_[t];
+      while (idx != tab.capacity && !is_full (tab.control[idx])) {
+	++idx;
+      }
+      if (idx != tab.capacity) {
+	return;
+      }
+      if (t == 0 && migrating_) {
+	t = OLD;
+	idx = 0;
+      }
+      else {
+	// End.
+	t = -1;
+	idx = 0;
+	return;
+      }
+    }
+  }
+
+  // Move MIGRATE_STEP slots from the old table to the current table.
+  inline void
+  migrate (size_type step)
+  {
+    table& old = tables_[OLD];
+    for (; step != 0 && migrate_idx_ != old.capacity; --step, ++migrate_idx_) {
+      if (is_full (old.control[migrate_idx_])) {
+	place (tables_[0], old.slots[migrate_idx_], Hash::operator() (Selector::operator () (old.slots[migrate_idx_])));
+	remove (old, migrate_idx_);
+      }
+    }
+
+    if (migrate_idx_ == old.capacity) {
+      destroy_table (old);
+      migrating_ = false;
+    }
+  }
+
+  // Start an incremental rehash if the current table is more than 3/4 used.
+  inline void
+  grow ()
+  {
+    table& cur = tables_[0];
+    if (4 * (cur.used + 1) <= 3 * cur.capacity) {
+      return;
+    }
+
+    if (migrating_) {
+      // Finish the previous rehash.
+      migrate (tables_[OLD].capacity);
+    }
+
+    // Double if full of values.  Otherwise, the same capacity discards the deleted slots.
+    const size_type capacity = (2 * cur.size >= cur.capacity) ? 2 * cur.capacity : cur.capacity;
+    tables_[OLD] = cur;
+    create_table (tables_[0], capacity);
+    migrating_ = true;
+    migrate_idx_ = 0;
+  }
+
+  inline bool
+  find_ (const key_type& key,
+	 int& t,
+	 size_type& idx) const
+  {
+    const size_t hash = Hash::operator() (key);
+    idx = find_in_table (tables_[0], key, hash);
+    if (idx != tables_[0].capacity) {
+      t = 0;
+      return true;
+    }
+    if (migrating_) {
+      idx = find_in_table (tables_[OLD], key, hash);
+      if (idx != tables_[OLD].capacity) {
+	t = OLD;
+	return true;
+      }
+    }
+    return false;
+  }
+
+  uno_assoc_cont&
+  operator= (const uno_assoc_cont&);
+
+public:
+  uno_assoc_cont () :
+    migrating_ (false),
+    migrate_idx_ (0)
+  {
+    create_table (tables_[0], MIN_CAPACITY);
+    tables_[OLD].control = 0;
+    tables_[OLD].slots = 0;
+    tables_[OLD].capacity = 0;
+    tables_[OLD].size = 0;
+    tables_[OLD].used = 0;
+  }
+
+  uno_assoc_cont (const uno_assoc_cont& other) :
+    Selector (other),
+    Hash (other),
+    Equal (other),
+    migrating_ (false),
+    migrate_idx_ (0)
+  {
+    size_type capacity = MIN_CAPACITY;
+    while (4 * other.size () > 3 * capacity) {
+      capacity *= 2;
+    }
+    create_table (tables_[0], capacity);
+    tables_[OLD].control = 0;
+    tables_[OLD].slots = 0;
+    tables_[OLD].capacity = 0;
+    tables_[OLD].size = 0;
+    tables_[OLD].used = 0;
+    for (const_iterator pos = other.begin (); pos != other.end (); ++pos) {
+      place (tables_[0], *pos, Hash::operator() (Selector::operator () (*pos)));
     }
   }
 
   void
   clear ()
   {
-    for (size_type idx = 0; idx < lookup_size_; ++idx) {
-      while (lookup_[idx] != 0) {
-	bucket_type* tmp = lookup_[idx];
-	lookup_[idx] = tmp->next;
-	Allocator::destroy (&tmp->value);
-	bucket_allocator::deallocate (tmp, 1);
-      }
+    if (migrating_) {
+      destroy_table (tables_[OLD]);
+      migrating_ = false;
     }
-    size_ = 0;
+    clear_table (tables_[0]);
   }
 
   ~uno_assoc_cont ()
   {
-    clear ();
-    lookup_allocator::deallocate (lookup_, lookup_size_);
+    if (migrating_) {
+      destroy_table (tables_[OLD]);
+    }
+    destroy_table (tables_[0]);
   }
 
   size_type
   size () const
   {
-    return size_;
+    return tables_[0].size + (migrating_ ? tables_[OLD].size : 0);
   }
 
   bool
   empty () const
   {
-    return size_ == 0;
+    return size () == 0;
   }
 
   const_iterator
   begin () const
   {
-    for (size_type idx = 0; idx < lookup_size_; ++idx) {
-      if (lookup_[idx] != 0) {
-	return iterator (this, lookup_[idx]);
-      }
-    }
-
-    return end ();
+    int t = 0;
+    size_type idx = 0;
+    next_full (t, idx);
+    return const_iterator (this, t, idx);
   }
 
   iterator
   end ()
   {
-    return iterator (this, 0);
+    return iterator (this, -1, 0);
   }
 
   const_iterator
   end () const
   {
-    return const_iterator (this, 0);
-  }
-
-private:
-  bucket_type* find_ (const key_type& key) const
-  {
-    // Compute the hash.
-    size_t hash = Hash::operator() (key);
-    // Compute the key into the lookup table.
-    size_type lookup_key = hash % lookup_size_;
-    // Begin a search.
-    for (bucket_type* bucket = lookup_[lookup_key];
-	 bucket != 0;
-	 bucket = bucket->next) {
-      if (bucket->hash == hash && Equal::operator() (Selector::operator () (bucket->value), key)) {
-	// Found it.
-	return bucket;
-      }
-    }
-
-    return 0;
+    return const_iterator (this, -1, 0);
   }
 
-public:
-
   iterator
   find (const key_type& key)
   {
-    bucket_type* bucket = find_ (key);
-    if (bucket != 0) {
-      return iterator (this, bucket);
+    int t;
+    size_type idx;
+    if (find_ (key, t, idx)) {
+      return iterator (this, t, idx);
     }
     else {
       return end ();
@@ -288,9 +486,10 @@ public:
   const_iterator
   find (const key_type& key) const
   {
-    bucket_type* bucket = find_ (key);
-    if (bucket != 0) {
-      return const_iterator (this, bucket);
+    int t;
+    size_type idx;
+    if (find_ (key, t, idx)) {
+      return const_iterator (this, t, idx);
     }
     else {
       return end ();
@@ -300,100 +499,37 @@ public:
   pair<iterator, bool>
   insert (const value_type& value)
   {
-    // Compute the hash.
-    size_t hash = Hash::operator() (Selector::operator () (value));
-    // Compute the key into the lookup table.
-    size_type lookup_key = hash % lookup_size_;
-    // Begin a search.
-    for (bucket_type* bucket = lookup_[lookup_key];
-	 bucket != 0;
-	 bucket = bucket->next) {
-      if (bucket->hash == hash && Equal::operator() (Selector::operator () (bucket->value), Selector::operator () (value))) {
-	// Found it.
-	return make_pair (iterator (this, bucket), false);
-      }
+    int t;
+    size_type idx;
+    if (find_ (Selector::operator () (value), t, idx)) {
+      // Found it.
+      return make_pair (iterator (this, t, idx), false);
     }
 
-    bucket_type* bucket = bucket_allocator::allocate (1);
-    Allocator::construct (&bucket->value, value);
-    ++size_;
-    bucket->hash = hash;
-    bucket->next = lookup_[lookup_key];
-    lookup_[lookup_key] = bucket;
-
-    // Rehash when size_ / lookup_size_ > .80
-    // Rehash when size_ / lookup_size_ > 80 / 100
-    // Rehash when 100 * size_ > 80 * lookup_size_
-    if (100 * size_ > 80 * lookup_size_) {
-      size_type new_lookup_size = 2 * lookup_size_;
-      bucket_type** new_lookup = lookup_allocator::allocate (new_lookup_size);
-      for (size_type idx = 0; idx < new_lookup_size; ++idx) {
-    	new_lookup[idx] = 0;
-      }
-
-      for (size_type idx = 0; idx < lookup_size_; ++idx) {
-    	while (lookup_[idx] != 0) {
-    	  // Remove from the old lookup table.
-    	  bucket_type* tmp = lookup_[idx];
-    	  lookup_[idx] = tmp->next;
-    	  // Compute the new lookup index.
-    	  size_type new_idx = tmp->hash % new_lookup_size;
-    	  // Insert into the new table.
-    	  tmp->next = new_lookup[new_idx];
-    	  new_lookup[new_idx] = tmp;
-    	}
-      }
-
-      lookup_allocator::deallocate (lookup_, lookup_size_);
-      lookup_ = new_lookup;
-      lookup_size_ = new_lookup_size;
+    // Move values before placing the new one so the returned iterator stays valid.
+    if (migrating_) {
+      migrate (MIGRATE_STEP);
     }
+    grow ();
 
-    return make_pair (iterator (this, bucket), true);
+    idx = place (tables_[0], value, Hash::operator() (Selector::operator () (value)));
+    return make_pair (iterator (this, 0, idx), true);
   }
 
   void
   erase (const_iterator pos)
   {
-    // Find the bucket.
-    // Compute the key into the lookup table.
-    size_type lookup_key = pos.bucket_->hash % lookup_size_;
-    // Begin a search.
-    for (bucket_type** bucket = &lookup_[lookup_key];
-	 *bucket != 0;
-	 bucket = &((*bucket)->next)) {
-      if (*bucket == pos.bucket_) {
-	// Found it.
-	bucket_type* tmp = *bucket;
-	*bucket = tmp->next;
-	Allocator::destroy (&tmp->value);
-	bucket_allocator::deallocate (tmp, 1);
-	--size_;
-	break;
-      }
-    }
+    remove (tables_[pos.table_], pos.idx_);
   }
 
   size_type
   erase (const key_type& key)
   {
-    // Compute the hash.
-    size_t hash = Hash::operator() (key);
-    // Compute the key into the lookup table.
-    size_type lookup_key = hash % lookup_size_;
-    // Begin a search.
-    for (bucket_type** bucket = &lookup_[lookup_key];
-	 *bucket != 0;
-	 bucket = &((*bucket)->next)) {
-      if ((*bucket)->hash == hash && Equal::operator() (Selector::operator () ((*bucket)->value), key)) {
-	// Found it.
-	bucket_type* tmp = *bucket;
-	*bucket = tmp->next;
-	Allocator::destroy (&tmp->value);
-	bucket_allocator::deallocate (tmp, 1);
-	--size_;
-	return 1;
-      }
+    int t;
+    size_type idx;
+    if (find_ (key, t, idx)) {
+      remove (tables_[t], idx);
+      return 1;
     }
 
     return 0;
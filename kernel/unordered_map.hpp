@@ -1,6 +1,7 @@
 #ifndef __unordered_map_hpp__
 #define __unordered_map_hpp__
 
+#include "slab_allocator.hpp"
 #include "uno_assoc_impl.hpp"
 #include "memory.hpp"
 
@@ -18,7 +19,7 @@ template <typename Key,
 	  typename T,
 	  typename Hash = hash<Key>,
 	  typename Equal = equal_to<Key>,
-	  typename Allocator = allocator<pair<const Key, T> > >
+	  typename Allocator = slab_allocator<pair<const Key, T> > >
 class unordered_map : public uno_assoc_cont<Key, pair<const Key, T>, first_selector<const Key, T>, Hash, Equal, Allocator> {
 private:
   typedef uno_assoc_cont<Key, pair<const Key, T>, first_selector<const Key, T>, Hash, Equal, Allocator> impl_type;
@@ -60,6 +60,19 @@ public:
     }
   }
 
+  vector&
+  operator= (const vector& other)
+  {
+    if (this != &other) {
+      clear ();
+      reserve (other.size ());
+      for (T* p = other.begin_; p != other.end_; ++p) {
+	Allocator::construct (end_++, *p);
+      }
+    }
+    return *this;
+  }
+
   ~vector ()
   {
     for (T* ptr = begin_; ptr != end_; ++ptr) {
@@ -22,10 +22,16 @@
 namespace vm {
   struct page_directory;
   struct page_table;
+#ifdef LILY_PAE
+  struct page_directory_pointer_table;
+#endif
 }
 
 extern vm::page_directory kernel_page_directory;
 extern vm::page_table kernel_page_table;
+#ifdef LILY_PAE
+extern vm::page_directory_pointer_table kernel_page_directory_pointer_table;
+#endif
 // A frame containing nothing but zeroes.
 extern int zero_page;
 
@@ -53,7 +59,8 @@ namespace vm {
 
   enum page_size_t {
     PAGE_SIZE_4K = 0,
-    PAGE_SIZE_4M = 1,
+    // 4MB or 2MB with PAE.
+    PAGE_SIZE_LARGE = 1,
   };
 
   enum writable_t {
@@ -79,20 +86,21 @@ namespace vm {
   inline page_table_idx_t
   get_page_table_idx (logical_address_t address)
   {
-    return (address & 0x3FF000) >> 12;
+    return (address >> FRAME_SHIFT) & (PAGE_ENTRY_COUNT - 1);
   }
   
+  // With PAE, the index spans all four page directories.
   inline page_table_idx_t
   get_page_directory_idx (logical_address_t address)
   {
-    return (address & 0xFFC00000) >> 22;
+    return address >> DIRECTORY_SHIFT;
   }
   
   inline logical_address_t
   get_address (page_table_idx_t directory_entry,
 	       page_table_idx_t table_entry)
   {
-    return (directory_entry << 22 | table_entry << 12);
+    return (directory_entry << DIRECTORY_SHIFT | table_entry << FRAME_SHIFT);
   }
 
   struct page_table_entry {
@@ -109,6 +117,12 @@ namespace vm {
     unsigned int buffer_ : 1;
     unsigned int available_ : 1;
     unsigned int frame_ : 20;
+#ifdef LILY_PAE
+    // The upper half of a PAE entry.
+    unsigned int frame_high_ : 20;
+    unsigned int available_high_ : 11;
+    unsigned int execute_disable_ : 1;
+#endif
     
     page_table_entry () :
       present_ (NOT_PRESENT),
@@ -124,6 +138,11 @@ namespace vm {
       buffer_ (NOT_BUFFER),
       available_ (0),
       frame_ (0)
+#ifdef LILY_PAE
+      , frame_high_ (0),
+      available_high_ (0),
+      execute_disable_ (0)
+#endif
     { }
 
     page_table_entry (frame_t frame,
@@ -131,7 +150,8 @@ namespace vm {
 		      buffer_t buf,
 		      page_privilege_t privilege,
 		      writable_t writable,
-		      present_t present) :
+		      present_t present,
+		      global_t global = NOT_GLOBAL) :
       present_ (present),
       writable_ (writable),
       user_ (privilege),
@@ -140,12 +160,27 @@ namespace vm {
       accessed_ (0),
       dirty_ (0),
       zero_ (0),
-      global_ (NOT_GLOBAL),
+      global_ (global),
       copy_on_write_ (cow),
       buffer_ (buf),
       available_ (0),
       frame_ (frame)
+#ifdef LILY_PAE
+      , frame_high_ (frame >> 20),
+      available_high_ (0),
+      execute_disable_ (0)
+#endif
     { }
+
+    inline frame_t
+    frame () const
+    {
+#ifdef LILY_PAE
+      return frame_ | (static_cast<frame_t> (frame_high_) << 20);
+#else
+      return frame_;
+#endif
+    }
   };
   
   struct page_table {
@@ -164,6 +199,12 @@ namespace vm {
     unsigned int ignored_ : 1;
     unsigned int available_ : 3;
     unsigned int frame_ : 20;
+#ifdef LILY_PAE
+    // The upper half of a PAE entry.
+    unsigned int frame_high_ : 20;
+    unsigned int available_high_ : 11;
+    unsigned int execute_disable_ : 1;
+#endif
 
     page_directory_entry () :
       present_ (NOT_PRESENT),
@@ -177,6 +218,11 @@ namespace vm {
       ignored_ (0),
       available_ (0),
       frame_ (0)
+#ifdef LILY_PAE
+      , frame_high_ (0),
+      available_high_ (0),
+      execute_disable_ (0)
+#endif
     { }
     
     page_directory_entry (frame_t frame,
@@ -193,37 +239,88 @@ namespace vm {
       ignored_ (0),
       available_ (0),
       frame_ (frame)
+#ifdef LILY_PAE
+      , frame_high_ (frame >> 20),
+      available_high_ (0),
+      execute_disable_ (0)
+#endif
     { }
+
+    inline frame_t
+    frame () const
+    {
+#ifdef LILY_PAE
+      return frame_ | (static_cast<frame_t> (frame_high_) << 20);
+#else
+      return frame_;
+#endif
+    }
+
+    // A large page.  The low bits of the frame in a large page entry are reserved so the physical address must be aligned to LARGE_PAGE_SIZE.
+    static inline page_directory_entry
+    large_page (physical_address_t physical_addr,
+		page_privilege_t privilege)
+    {
+      page_directory_entry e (physical_address_to_frame (physical_addr), privilege, PRESENT);
+      e.page_size_ = PAGE_SIZE_LARGE;
+      return e;
+    }
   };
   
+  // The page directories of an address space.
+  // With PAE, the four page directories are mapped consecutively in the paging area so they can be indexed as one.
   struct page_directory {
-    page_directory_entry entry[PAGE_ENTRY_COUNT];
+    page_directory_entry entry[DIRECTORY_ENTRY_COUNT];
+  };
 
-    page_directory (frame_t frame,
-		    page_privilege_t paging_area_privilege,
-		    page_privilege_t kernel_data_privilege)
-    {
-      // The kernel page directory.
-      const page_directory* src = reinterpret_cast<page_directory*> (reinterpret_cast<logical_address_t> (&kernel_page_directory) + KERNEL_VIRTUAL_BASE);
-      // Avoid the last entry.
-      for (page_table_idx_t idx = get_page_directory_idx (KERNEL_VIRTUAL_BASE); idx != PAGE_ENTRY_COUNT - 1; ++idx) {
-	if (src->entry[idx].present_ == PRESENT) {
-	  entry[idx] = src->entry[idx];
-	  frame_manager::incref (entry[idx].frame_);
-	  entry[idx].user_ = kernel_data_privilege;
-	}
-      }
+#ifdef LILY_PAE
+  // The processor loads the entries of the page directory pointer table when CR3 is loaded.
+  // Thus, the page directories of an address space are allocated when it is created and never change.
+  struct page_directory_pointer_entry {
+    unsigned int present_ : 1;
+    unsigned int zero_ : 2;
+    unsigned int write_through_ : 1;
+    unsigned int cache_disabled_ : 1;
+    unsigned int zero_high_ : 4;
+    unsigned int available_ : 3;
+    unsigned int frame_ : 20;
+    unsigned int frame_high_ : 20;
+    unsigned int reserved_ : 12;
 
-      // Map the page directory to itself.
-      entry[PAGE_ENTRY_COUNT - 1] = page_directory_entry (frame, paging_area_privilege, PRESENT);
-      frame_manager::incref (frame);
+    page_directory_pointer_entry (frame_t frame) :
+      present_ (PRESENT),
+      zero_ (0),
+      write_through_ (WRITE_BACK),
+      cache_disabled_ (CACHED),
+      zero_high_ (0),
+      available_ (0),
+      frame_ (frame),
+      frame_high_ (frame >> 20),
+      reserved_ (0)
+    { }
+
+    inline frame_t
+    frame () const
+    {
+      return frame_ | (static_cast<frame_t> (frame_high_) << 20);
     }
   };
 
+  struct page_directory_pointer_table {
+    page_directory_pointer_entry entry[PAGE_DIRECTORY_COUNT];
+  };
+#endif
+
+  // The value of CR3 for the kernel.
+  // With PAE, this is the page directory pointer table which is in the kernel's data.
   inline physical_address_t
   get_kernel_page_directory_physical_address (void)
   {
+#ifdef LILY_PAE
+    return reinterpret_cast<physical_address_t> (&kernel_page_directory_pointer_table) - KERNEL_VIRTUAL_BASE;
+#else
     return reinterpret_cast<physical_address_t> (&kernel_page_directory);
+#endif
   }
 
   inline page_directory*
@@ -235,20 +332,21 @@ namespace vm {
   inline page_directory*
   get_page_directory (void)
   {
-    /* Because the page directory is mapped to itself. */
-    return reinterpret_cast<page_directory*> (0xFFFFF000);
+    /* Because the page directories are mapped to themselves. */
+    return reinterpret_cast<page_directory*> (PAGING_AREA + get_page_directory_idx (PAGING_AREA) * PAGE_SIZE);
   }
 
   inline page_table*
   get_page_table (logical_address_t address)
   {
-    return reinterpret_cast<page_table*> (0xFFC00000 + get_page_directory_idx (address) * PAGE_SIZE);
+    return reinterpret_cast<page_table*> (PAGING_AREA + get_page_directory_idx (address) * PAGE_SIZE);
   }
   
+  // The frame of the last page directory.
   inline frame_t
   page_directory_frame (void)
   {
-    return get_page_directory ()->entry[PAGE_ENTRY_COUNT - 1].frame_;
+    return get_page_directory ()->entry[DIRECTORY_ENTRY_COUNT - 1].frame ();
   }
 
   // NOTE:  This is a shared resource.
@@ -283,7 +381,7 @@ namespace vm {
     kassert (pd->entry[directory_entry].present_ == PRESENT);
     kassert (pt->entry[table_entry].present_ == PRESENT);
 
-    return pt->entry[table_entry].frame_;
+    return pt->entry[table_entry].frame ();
   }
 
   enum map_mode_t {
@@ -292,20 +390,102 @@ namespace vm {
     MAP_COPY_ON_WRITE = 2,
   };
 
+  // When invalidating more than this many pages, reloading CR3 is cheaper than invlpg.
+  const size_t INVLPG_LIMIT = 32;
+
+  // Flush all non-global entries from the TLB.
   inline void
-  map (logical_address_t logical_addr,
-       frame_t fr,
-       page_privilege_t privilege,
-       map_mode_t map_mode,
-       bool incref = true,
-       buffer_t buf = NOT_BUFFER)
+  flush_tlb (void)
   {
-    kassert (fr != vm::zero_frame () || map_mode == vm::MAP_COPY_ON_WRITE || map_mode == vm::MAP_READ_ONLY);
+    physical_address_t dir;
+    asm ("mov %%cr3, %0\n"
+	 "mov %0, %%cr3\n" : "=r"(dir) : : "memory");
+  }
+
+  // The kernel is mapped identically in every page directory so its pages are global.
+  // The global bit is ignored unless enabled with enable_global_pages.
+  inline global_t
+  global_for (logical_address_t logical_addr)
+  {
+    return (logical_addr >= KERNEL_VIRTUAL_BASE && logical_addr < PAGING_AREA) ? GLOBAL : NOT_GLOBAL;
+  }
+
+  // Keep global pages in the TLB when CR3 is loaded.
+  inline void
+  enable_global_pages (void)
+  {
+    uint32_t cr4;
+    asm ("mov %%cr4, %0\n" : "=r"(cr4));
+    cr4 |= (1 << 7);
+    asm ("mov %0, %%cr4\n" : : "r"(cr4) : "memory");
+  }
+
+  // Allow page directory entries to map 4MB pages.
+  // Page directory entries always map 2MB pages with PAE.
+  inline void
+  enable_large_pages (void)
+  {
+    uint32_t cr4;
+    asm ("mov %%cr4, %0\n" : "=r"(cr4));
+    cr4 |= (1 << 4);
+    asm ("mov %0, %%cr4\n" : : "r"(cr4) : "memory");
+  }
+
+  inline bool
+  large_pages_enabled (void)
+  {
+#ifdef LILY_PAE
+    return true;
+#else
+    uint32_t cr4;
+    asm ("mov %%cr4, %0\n" : "=r"(cr4));
+    return (cr4 & (1 << 4)) != 0;
+#endif
+  }
+
+  // Invalidate the TLB entries for [begin, end).
+  inline void
+  invalidate (logical_address_t begin,
+	      logical_address_t end)
+  {
+    // Reloading CR3 does not flush global pages.
+    if ((end - begin) / PAGE_SIZE > INVLPG_LIMIT && end <= KERNEL_VIRTUAL_BASE) {
+      flush_tlb ();
+    }
+    else {
+      for (; begin != end; begin += PAGE_SIZE) {
+	asm ("invlpg (%0)\n" :: "r"(begin));
+      }
+    }
+  }
+
+  inline page_table_entry
+  make_page_table_entry (logical_address_t logical_addr,
+			 frame_t fr,
+			 page_privilege_t privilege,
+			 map_mode_t map_mode,
+			 buffer_t buf)
+  {
+    const global_t global = global_for (logical_addr);
+    switch (map_mode) {
+    case MAP_READ_WRITE:
+      return page_table_entry (fr, vm::NOT_COPY_ON_WRITE, buf, privilege, vm::WRITABLE, PRESENT, global);
+    case MAP_READ_ONLY:
+      return page_table_entry (fr, vm::NOT_COPY_ON_WRITE, buf, privilege, vm::NOT_WRITABLE, PRESENT, global);
+    case MAP_COPY_ON_WRITE:
+      return page_table_entry (fr, vm::COPY_ON_WRITE, buf, privilege, vm::NOT_WRITABLE, PRESENT, global);
+    }
+    kpanic ("Bad map mode");
+    return page_table_entry ();
+  }
 
+  // Return the page table for the address allocating it if necessary.
+  inline page_table*
+  get_or_create_page_table (logical_address_t logical_addr)
+  {
     page_directory* page_directory = get_page_directory ();
     page_table* pt = get_page_table (logical_addr);
     const page_table_idx_t directory_entry = get_page_directory_idx (logical_addr);
-    const page_table_idx_t table_entry = get_page_table_idx (logical_addr);
 
     if (page_directory->entry[directory_entry].present_ == NOT_PRESENT) {
       frame_t frame = frame_manager::alloc ();
@@ -317,20 +497,37 @@ namespace vm {
       new (pt) vm::page_table ();
     }
 
+    return pt;
+  }
+
+  // Allocate every page table in the kernel region.
+  // Page directories copy the kernel entries when they are created so all of them share the kernel page tables.
+  // Thus, growing the kernel heap is visible to every page directory immediately.
+  inline void
+  populate_kernel_page_tables (void)
+  {
+    for (logical_address_t address = KERNEL_VIRTUAL_BASE; address != PAGING_AREA; address += LARGE_PAGE_SIZE) {
+      get_or_create_page_table (address);
+    }
+  }
+
+  inline void
+  map (logical_address_t logical_addr,
+       frame_t fr,
+       page_privilege_t privilege,
+       map_mode_t map_mode,
+       bool incref = true,
+       buffer_t buf = NOT_BUFFER)
+  {
+    kassert (fr != vm::zero_frame () || map_mode == vm::MAP_COPY_ON_WRITE || map_mode == vm::MAP_READ_ONLY);
+
+    page_table* pt = get_or_create_page_table (logical_addr);
+    const page_table_idx_t table_entry = get_page_table_idx (logical_addr);
+
     // The entry should not be present.
     kassert (pt->entry[table_entry].present_ == NOT_PRESENT);
     // Map.
-    switch (map_mode) {
-    case MAP_READ_WRITE:
-      pt->entry[table_entry] = page_table_entry (fr, vm::NOT_COPY_ON_WRITE, buf, privilege, vm::WRITABLE, PRESENT);
-      break;
-    case MAP_READ_ONLY:
-      pt->entry[table_entry] = page_table_entry (fr, vm::NOT_COPY_ON_WRITE, buf, privilege, vm::NOT_WRITABLE, PRESENT);
-      break;
-    case MAP_COPY_ON_WRITE:
-      pt->entry[table_entry] = page_table_entry (fr, vm::COPY_ON_WRITE, buf, privilege, vm::NOT_WRITABLE, PRESENT);
-      break;
-    }
+    pt->entry[table_entry] = make_page_table_entry (logical_addr, fr, privilege, map_mode, buf);
     if (incref) {
       frame_manager::incref (fr);
     }
@@ -338,6 +535,73 @@ namespace vm {
     asm ("invlpg (%0)\n" :: "r"(logical_addr));
   }
 
+  // Map a sequence of frames to consecutive pages starting at logical_addr.
+  // Each page table is looked up once.
+  // The TLB does not cache entries that are not present so no invalidation is necessary.
+  template <typename InputIterator>
+  inline void
+  map_range (logical_address_t logical_addr,
+	     InputIterator begin,
+	     InputIterator end,
+	     page_privilege_t privilege,
+	     map_mode_t map_mode,
+	     bool incref = true,
+	     buffer_t buf = NOT_BUFFER)
+  {
+    while (begin != end) {
+      page_table* pt = get_or_create_page_table (logical_addr);
+      for (page_table_idx_t table_entry = get_page_table_idx (logical_addr);
+	   table_entry != PAGE_ENTRY_COUNT && begin != end;
+	   ++table_entry, ++begin, logical_addr += PAGE_SIZE) {
+	kassert (*begin != vm::zero_frame () || map_mode == vm::MAP_COPY_ON_WRITE || map_mode == vm::MAP_READ_ONLY);
+	// The entry should not be present.
+	kassert (pt->entry[table_entry].present_ == NOT_PRESENT);
+	pt->entry[table_entry] = make_page_table_entry (logical_addr, *begin, privilege, map_mode, buf);
+	if (incref) {
+	  frame_manager::incref (*begin);
+	}
+      }
+    }
+  }
+
+  // Returns true if a large page can be mapped at logical_addr, i.e., no page table exists for it.
+  inline bool
+  can_map_large (logical_address_t logical_addr)
+  {
+    return large_pages_enabled () &&
+      is_aligned (logical_addr, LARGE_PAGE_SIZE) &&
+      get_page_directory ()->entry[get_page_directory_idx (logical_addr)].present_ == NOT_PRESENT;
+  }
+
+  inline bool
+  is_large_page (logical_address_t logical_addr)
+  {
+    const page_directory_entry& e = get_page_directory ()->entry[get_page_directory_idx (logical_addr)];
+    return e.present_ == PRESENT && e.page_size_ == PAGE_SIZE_LARGE;
+  }
+
+  // Map the LARGE_PAGE_SIZE bytes of physical memory at physical_addr to logical_addr.
+  // Large pages are only used for memory not managed by the frame manager so there is no reference counting.
+  inline void
+  map_large (logical_address_t logical_addr,
+	     physical_address_t physical_addr,
+	     page_privilege_t privilege)
+  {
+    kassert (can_map_large (logical_addr));
+    kassert (is_aligned (physical_addr, LARGE_PAGE_SIZE));
+    get_page_directory ()->entry[get_page_directory_idx (logical_addr)] = page_directory_entry::large_page (physical_addr, privilege);
+    // The entry was not present so no invalidation is necessary.
+  }
+
+  inline void
+  unmap_large (logical_address_t logical_addr)
+  {
+    kassert (is_large_page (logical_addr));
+    get_page_directory ()->entry[get_page_directory_idx (logical_addr)] = page_directory_entry ();
+    // One invlpg removes the entire large page from the TLB.
+    asm ("invlpg (%0)\n" :: "r"(logical_addr));
+  }
+
   inline void
   remap (logical_address_t logical_addr,
 	 page_privilege_t privilege,
@@ -354,17 +618,7 @@ namespace vm {
     kassert (page_directory->entry[directory_entry].present_ == PRESENT);
     kassert (page_table->entry[table_entry].present_ == PRESENT);
 
-    switch (map_mode) {
-    case MAP_READ_WRITE:
-      page_table->entry[table_entry] = page_table_entry (page_table->entry[table_entry].frame_, vm::NOT_COPY_ON_WRITE, buf, privilege, vm::WRITABLE, PRESENT);
-      break;
-    case MAP_READ_ONLY:
-      page_table->entry[table_entry] = page_table_entry (page_table->entry[table_entry].frame_, vm::NOT_COPY_ON_WRITE, buf, privilege, vm::NOT_WRITABLE, PRESENT);
-      break;
-    case MAP_COPY_ON_WRITE:
-      page_table->entry[table_entry] = page_table_entry (page_table->entry[table_entry].frame_, vm::COPY_ON_WRITE, buf, privilege, vm::NOT_WRITABLE, PRESENT);
-      break;
-    }
+    page_table->entry[table_entry] = make_page_table_entry (logical_addr, page_table->entry[table_entry].frame (), privilege, map_mode, buf);
 
     /* Flush the TLB. */
     asm ("invlpg (%0)\n" :: "r"(logical_addr));
@@ -383,7 +637,7 @@ namespace vm {
     if (page_directory->entry[directory_entry].present_ == PRESENT &&
 	page_table->entry[table_entry].present_ == PRESENT) {
       if (decref) {
-	frame_manager::decref (page_table->entry[table_entry].frame_);
+	frame_manager::decref (page_table->entry[table_entry].frame ());
       }
       page_table->entry[table_entry] = page_table_entry ();
       /* Flush the TLB. */
@@ -395,6 +649,149 @@ namespace vm {
 
   }
 
+  // Get the frames of the page directories of an address space given the value of CR3.
+  inline void
+  get_directory_frames (physical_address_t directory,
+			frame_t (&frames)[PAGE_DIRECTORY_COUNT])
+  {
+#ifdef LILY_PAE
+    map (get_stub1 (), physical_address_to_frame (directory), SUPERVISOR, MAP_READ_ONLY);
+    const page_directory_pointer_table* pdpt = reinterpret_cast<const page_directory_pointer_table*> (get_stub1 ());
+    for (size_t d = 0; d != PAGE_DIRECTORY_COUNT; ++d) {
+      frames[d] = pdpt->entry[d].frame ();
+    }
+    unmap (get_stub1 ());
+#else
+    frames[0] = physical_address_to_frame (directory);
+#endif
+  }
+
+  // Create the page directories for a new address space and return the value for CR3 or 0 if there is no memory.
+  // The kernel page tables are shared with the kernel page directory.
+  // Each page directory has a reference from allocation and a reference from mapping it to itself.
+  inline physical_address_t
+  create_directory (page_privilege_t paging_area_privilege,
+		    page_privilege_t kernel_data_privilege)
+  {
+#ifdef LILY_PAE
+    // CR3 holds a 32-bit address.
+    // The table only needs 32 bytes but a frame is used so it can be reference counted like the page directories.
+    const frame_t frame = frame_manager::alloc_low ();
+    if (frame == 0) {
+      return 0;
+    }
+#endif
+
+    frame_t frames[PAGE_DIRECTORY_COUNT];
+    for (size_t d = 0; d != PAGE_DIRECTORY_COUNT; ++d) {
+      frames[d] = frame_manager::alloc ();
+      kassert (frames[d] != zero_frame ());
+    }
+
+    const page_directory* src = get_kernel_page_directory ();
+    const page_table_idx_t kernel_begin = get_page_directory_idx (KERNEL_VIRTUAL_BASE);
+    const page_table_idx_t paging_begin = get_page_directory_idx (PAGING_AREA);
+    // Initialize the page directories one at a time through the stub.
+    for (size_t d = 0; d != PAGE_DIRECTORY_COUNT; ++d) {
+      map (get_stub1 (), frames[d], USER, MAP_READ_WRITE);
+      page_directory_entry* entry = reinterpret_cast<page_directory_entry*> (get_stub1 ());
+      for (page_table_idx_t idx = d * PAGE_ENTRY_COUNT; idx != (d + 1) * PAGE_ENTRY_COUNT; ++idx) {
+	page_directory_entry& e = entry[idx - d * PAGE_ENTRY_COUNT];
+	if (idx >= paging_begin) {
+	  // Map the page directories to themselves.
+	  e = page_directory_entry (frames[idx - paging_begin], paging_area_privilege, PRESENT);
+	  frame_manager::incref (frames[idx - paging_begin]);
+	}
+	else if (idx >= kernel_begin && src->entry[idx].present_ == PRESENT) {
+	  e = src->entry[idx];
+	  frame_manager::incref (e.frame ());
+	  e.user_ = kernel_data_privilege;
+	}
+	else {
+	  e = page_directory_entry ();
+	}
+      }
+      unmap (get_stub1 ());
+    }
+
+#ifdef LILY_PAE
+    map (get_stub1 (), frame, USER, MAP_READ_WRITE);
+    page_directory_pointer_table* pdpt = reinterpret_cast<page_directory_pointer_table*> (get_stub1 ());
+    for (size_t d = 0; d != PAGE_DIRECTORY_COUNT; ++d) {
+      pdpt->entry[d] = page_directory_pointer_entry (frames[d]);
+    }
+    unmap (get_stub1 ());
+    return frame_to_physical_address (frame);
+#else
+    return frame_to_physical_address (frames[0]);
+#endif
+  }
+
+  // Free the page directories of an address space.
+  // The references from mapping the page directories to themselves must have been dropped with the page tables.
+  inline void
+  destroy_directory (physical_address_t directory)
+  {
+    frame_t frames[PAGE_DIRECTORY_COUNT];
+    get_directory_frames (directory, frames);
+    for (size_t d = 0; d != PAGE_DIRECTORY_COUNT; ++d) {
+      size_t count = frame_manager::decref (frames[d]);
+      kassert (count == 0);
+    }
+#ifdef LILY_PAE
+    size_t count = frame_manager::decref (physical_address_to_frame (directory));
+    kassert (count == 0);
+#endif
+  }
+
+  // Count the page tables for user space in the page directories of an address space.
+  // The address space need not be the active one.
+  inline size_t
+  count_user_page_tables (physical_address_t directory)
+  {
+    frame_t frames[PAGE_DIRECTORY_COUNT];
+    get_directory_frames (directory, frames);
+    const page_table_idx_t kernel_begin = get_page_directory_idx (KERNEL_VIRTUAL_BASE);
+    size_t count = 0;
+    for (size_t d = 0; d != PAGE_DIRECTORY_COUNT && d * PAGE_ENTRY_COUNT < kernel_begin; ++d) {
+      map (get_stub1 (), frames[d], SUPERVISOR, MAP_READ_ONLY);
+      const page_directory_entry* entry = reinterpret_cast<const page_directory_entry*> (get_stub1 ());
+      for (page_table_idx_t idx = d * PAGE_ENTRY_COUNT; idx != (d + 1) * PAGE_ENTRY_COUNT && idx != kernel_begin; ++idx) {
+	const page_directory_entry& e = entry[idx - d * PAGE_ENTRY_COUNT];
+	if (e.present_ == PRESENT && e.page_size_ == PAGE_SIZE_4K) {
+	  ++count;
+	}
+      }
+      unmap (get_stub1 ());
+    }
+    return count;
+  }
+
+  // Unmap the pages [begin, end) which must be mapped.
+  // The TLB is invalidated once for the whole range.
+  inline void
+  unmap_range (logical_address_t begin,
+	       logical_address_t end,
+	       bool decref = true)
+  {
+    page_directory* page_directory = get_page_directory ();
+    logical_address_t logical_addr = begin;
+    while (logical_addr != end) {
+      kassert (page_directory->entry[get_page_directory_idx (logical_addr)].present_ == PRESENT);
+      page_table* page_table = get_page_table (logical_addr);
+      for (page_table_idx_t table_entry = get_page_table_idx (logical_addr);
+	   table_entry != PAGE_ENTRY_COUNT && logical_addr != end;
+	   ++table_entry, logical_addr += PAGE_SIZE) {
+	kassert (page_table->entry[table_entry].present_ == PRESENT);
+	if (decref) {
+	  frame_manager::decref (page_table->entry[table_entry].frame ());
+	}
+	page_table->entry[table_entry] = page_table_entry ();
+      }
+    }
+    invalidate (begin, end);
+  }
+
   inline void
   set_accessed (logical_address_t logical_addr,
 		bool flag)
@@ -449,6 +846,72 @@ namespace vm {
     return static_cast<buffer_t> (page_table->entry[table_entry].buffer_);
   }
 
+  // Returns true if the page is present and copy-on-write.
+  // Unlike get_copy_on_write, the page table need not be present.
+  inline bool
+  is_copy_on_write (logical_address_t logical_addr)
+  {
+    page_directory* page_directory = get_page_directory ();
+    const page_table_idx_t directory_entry = get_page_directory_idx (logical_addr);
+    
+    if (page_directory->entry[directory_entry].present_ == NOT_PRESENT) {
+      return false;
+    }
+
+    page_table* page_table = get_page_table (logical_addr);
+    const page_table_idx_t table_entry = get_page_table_idx (logical_addr);
+
+    return page_table->entry[table_entry].present_ == PRESENT && page_table->entry[table_entry].copy_on_write_ == COPY_ON_WRITE;
+  }
+
+  // Returns true if the page is present.
+  // The page table need not be present.
+  inline bool
+  is_present (logical_address_t logical_addr)
+  {
+    page_directory* page_directory = get_page_directory ();
+    const page_table_idx_t directory_entry = get_page_directory_idx (logical_addr);
+    
+    if (page_directory->entry[directory_entry].present_ == NOT_PRESENT) {
+      return false;
+    }
+
+    return get_page_table (logical_addr)->entry[get_page_table_idx (logical_addr)].present_ == PRESENT;
+  }
+
+  // Prepare a page to be shared with another page directory.
+  // A writable page becomes copy-on-write.
+  // Returns false if the page is not present.
+  // Otherwise, sets frame and map_mode to the frame and mode for the other page directory.
+  inline bool
+  share (logical_address_t logical_addr,
+	 frame_t& frame,
+	 map_mode_t& map_mode)
+  {
+    page_directory* page_directory = get_page_directory ();
+    const page_table_idx_t directory_entry = get_page_directory_idx (logical_addr);
+
+    if (page_directory->entry[directory_entry].present_ == NOT_PRESENT) {
+      return false;
+    }
+
+    page_table* page_table = get_page_table (logical_addr);
+    page_table_entry& entry = page_table->entry[get_page_table_idx (logical_addr)];
+
+    if (entry.present_ == NOT_PRESENT) {
+      return false;
+    }
+
+    frame = entry.frame ();
+    if (entry.writable_ == WRITABLE) {
+      entry.writable_ = NOT_WRITABLE;
+      entry.copy_on_write_ = COPY_ON_WRITE;
+      asm ("invlpg (%0)\n" :: "r"(logical_addr));
+    }
+    map_mode = (entry.copy_on_write_ == COPY_ON_WRITE) ? MAP_COPY_ON_WRITE : MAP_READ_ONLY;
+    return true;
+  }
+
   inline physical_address_t
   get_directory ()
   {
@@ -0,0 +1,358 @@
+#ifndef __vm_area_map_hpp__
+#define __vm_area_map_hpp__
+
+/*
+  File
+  ----
+  vm_area_map.hpp
+
+  Description
+  -----------
+  A sorted set of non-overlapping virtual memory areas.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+#include "vm_area.hpp"
+#include "slab_allocator.hpp"
+
+/*
+  The memory map of an automaton contains its text, data, heap, stack, memory mapped areas, and mapped buffers.
+  An automaton may map many buffers so the map is a treap, i.e., a randomized balanced binary search tree, ordered by address.
+  Inserting, erasing, and finding an area are logarithmic.
+
+  Mapping a buffer requires a hole between the heap and the stack.
+  Each node records the lowest address, highest address, and the largest hole between the areas in its subtree.
+  Subtrees whose largest hole is too small are skipped when searching for a hole.
+
+  An area must not change while it is in the map.
+  To change an area, erase it, change it, and insert it again.
+*/
+
+class vm_area_map {
+private:
+  struct node {
+    vm_area_base* area;
+    node* left;
+    node* right;
+    unsigned int priority;
+    // Lowest begin in the subtree.
+    logical_address_t min_begin;
+    // Highest end in the subtree.
+    logical_address_t max_end;
+    // Largest hole between two areas in the subtree.
+    size_t max_gap;
+  };
+
+  typedef slab_allocator<node> node_allocator;
+
+  node* root_;
+  unsigned int seed_;
+
+  // Areas are ordered by begin.  An empty area, e.g., a new heap, comes before a non-empty area with the same begin.
+  static inline bool
+  less (const vm_area_base* x,
+	const vm_area_base* y)
+  {
+    return x->begin () < y->begin () || (x->begin () == y->begin () && x->end () < y->end ());
+  }
+
+  static inline size_t
+  max (size_t x,
+       size_t y)
+  {
+    return x > y ? x : y;
+  }
+
+  static inline void
+  update (node* n)
+  {
+    n->min_begin = n->area->begin ();
+    n->max_end = n->area->end ();
+    n->max_gap = 0;
+    if (n->left != 0) {
+      n->min_begin = n->left->min_begin;
+      n->max_gap = max (n->left->max_gap, n->area->begin () - n->left->max_end);
+    }
+    if (n->right != 0) {
+      n->max_end = n->right->max_end;
+      n->max_gap = max (n->max_gap, max (n->right->max_gap, n->right->min_begin - n->area->end ()));
+    }
+  }
+
+  // Split t into areas less than area and areas not less than area.
+  static void
+  split (node* t,
+	 const vm_area_base* area,
+	 node*& l,
+	 node*& r)
+  {
+    if (t == 0) {
+      l = 0;
+      r = 0;
+    }
+    else if (less (t->area, area)) {
+      split (t->right, area, t->right, r);
+      l = t;
+      update (l);
+    }
+    else {
+      split (t->left, area, l, t->left);
+      r = t;
+      update (r);
+    }
+  }
+
+  // Merge l and r where every area in l is less than every area in r.
+  static node*
+  merge (node* l,
+	 node* r)
+  {
+    if (l == 0) {
+      return r;
+    }
+    if (r == 0) {
+      return l;
+    }
+    if (l->priority > r->priority) {
+      l->right = merge (l->right, r);
+      update (l);
+      return l;
+    }
+    else {
+      r->left = merge (l, r->left);
+      update (r);
+      return r;
+    }
+  }
+
+  static node*
+  insert (node* t,
+	  node* n)
+  {
+    if (t == 0) {
+      return n;
+    }
+    if (n->priority > t->priority) {
+      split (t, n->area, n->left, n->right);
+      update (n);
+      return n;
+    }
+    if (less (n->area, t->area)) {
+      t->left = insert (t->left, n);
+    }
+    else {
+      t->right = insert (t->right, n);
+    }
+    update (t);
+    return t;
+  }
+
+  static node*
+  erase (node* t,
+	 const vm_area_base* area)
+  {
+    kassert (t != 0);
+    if (t->area == area) {
+      node* n = merge (t->left, t->right);
+      node_allocator::deallocate (t, 1);
+      return n;
+    }
+    if (less (area, t->area)) {
+      t->left = erase (t->left, area);
+    }
+    else {
+      t->right = erase (t->right, area);
+    }
+    update (t);
+    return t;
+  }
+
+  static inline vm_area_base*
+  leftmost (node* t)
+  {
+    while (t->left != 0) {
+      t = t->left;
+    }
+    return t->area;
+  }
+
+  // Find the highest hole of at least size bytes between low and high.
+  // Returns the area above the hole.
+  static vm_area_base*
+  find_gap (node* t,
+	    size_t size,
+	    logical_address_t low,
+	    logical_address_t high)
+  {
+    if (t == 0 || t->max_gap < size || t->max_end < low || t->min_begin > high) {
+      return 0;
+    }
+
+    vm_area_base* a = find_gap (t->right, size, low, high);
+    if (a != 0) {
+      return a;
+    }
+
+    if (t->right != 0 &&
+	t->right->min_begin - t->area->end () >= size &&
+	t->area->end () >= low &&
+	t->right->min_begin <= high) {
+      return leftmost (t->right);
+    }
+
+    if (t->left != 0 &&
+	t->area->begin () - t->left->max_end >= size &&
+	t->left->max_end >= low &&
+	t->area->begin () <= high) {
+      return t->area;
+    }
+
+    return find_gap (t->left, size, low, high);
+  }
+
+  static void
+  destroy (node* t)
+  {
+    if (t != 0) {
+      destroy (t->left);
+      destroy (t->right);
+      node_allocator::deallocate (t, 1);
+    }
+  }
+
+  vm_area_map (const vm_area_map&);
+  vm_area_map& operator= (const vm_area_map&);
+
+public:
+  vm_area_map () :
+    root_ (0),
+    seed_ (1)
+  { }
+
+  ~vm_area_map ()
+  {
+    destroy (root_);
+  }
+
+  inline bool
+  empty () const
+  {
+    return root_ == 0;
+  }
+
+  // The area must not overlap an area in the map.
+  inline void
+  insert (vm_area_base* area)
+  {
+    kassert (area != 0);
+    node* n = node_allocator::allocate (1);
+    n->area = area;
+    n->left = 0;
+    n->right = 0;
+    seed_ = seed_ * 1103515245 + 12345;
+    n->priority = seed_;
+    update (n);
+    root_ = insert (root_, n);
+  }
+
+  inline void
+  erase (vm_area_base* area)
+  {
+    root_ = erase (root_, area);
+  }
+
+  // Return the area containing address or 0.
+  inline vm_area_base*
+  find (logical_address_t address) const
+  {
+    // Find the last area that begins at or before address.
+    vm_area_base* candidate = 0;
+    for (node* t = root_; t != 0;) {
+      if (t->area->begin () <= address) {
+	candidate = t->area;
+	t = t->right;
+      }
+      else {
+	t = t->left;
+      }
+    }
+
+    if (candidate != 0 && address < candidate->end ()) {
+      return candidate;
+    }
+    return 0;
+  }
+
+  inline vm_area_base*
+  first () const
+  {
+    return root_ != 0 ? leftmost (root_) : 0;
+  }
+
+  inline vm_area_base*
+  last () const
+  {
+    node* t = root_;
+    if (t == 0) {
+      return 0;
+    }
+    while (t->right != 0) {
+      t = t->right;
+    }
+    return t->area;
+  }
+
+  // Return the area following area or 0.
+  inline vm_area_base*
+  next (const vm_area_base* area) const
+  {
+    vm_area_base* n = 0;
+    for (node* t = root_; t != 0;) {
+      if (less (area, t->area)) {
+	n = t->area;
+	t = t->left;
+      }
+      else {
+	t = t->right;
+      }
+    }
+    return n;
+  }
+
+  // Returns true if [begin, end) does not overlap an area in the map.
+  inline bool
+  is_free (logical_address_t begin,
+	   logical_address_t end) const
+  {
+    const vm_area_base area (begin, end);
+    // Find the areas before and after.
+    vm_area_base* prev = 0;
+    vm_area_base* succ = 0;
+    for (node* t = root_; t != 0;) {
+      if (less (&area, t->area)) {
+	succ = t->area;
+	t = t->left;
+      }
+      else {
+	prev = t->area;
+	t = t->right;
+      }
+    }
+
+    return (prev == 0 || prev->end () <= begin) && (succ == 0 || end <= succ->begin ());
+  }
+
+  // Find the highest hole of at least size bytes that begins at or after low and ends at or before high.
+  // Returns the area above the hole or 0 if there is no such hole.
+  inline vm_area_base*
+  find_gap (size_t size,
+	    logical_address_t low,
+	    logical_address_t high) const
+  {
+    return find_gap (root_, size, low, high);
+  }
+};
+
+#endif /* __vm_area_map_hpp__ */
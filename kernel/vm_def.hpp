@@ -12,14 +12,48 @@ typedef size_t page_table_idx_t;
 
 static const size_t PAGE_SIZE = 0x1000;
 
-/* Number of entries in a page table or directory. */
+static const int FRAME_SHIFT = 12;
+
+#ifdef LILY_PAE
+/*
+  Physical Address Extension (PAE) paging.
+  Entries are 64 bits so a page table or directory has 512 entries.
+  Four page directories, one for each gigabyte, are selected by a page directory pointer table.
+  Physical addresses have 36 bits.
+*/
+
+/* Number of entries in a page table. */
+static const page_table_idx_t PAGE_ENTRY_COUNT = 512;
+
+/* Number of page directories in an address space. */
+static const size_t PAGE_DIRECTORY_COUNT = 4;
+
+/* A logical address shifted by this amount is the index of its entry in the page directories. */
+static const int DIRECTORY_SHIFT = 21;
+
+static const int PHYSICAL_ADDRESS_BITS = 36;
+#else
+/* Number of entries in a page table. */
 static const page_table_idx_t PAGE_ENTRY_COUNT = 1024;
 
-static const int FRAME_SHIFT = 12;
+/* Number of page directories in an address space. */
+static const size_t PAGE_DIRECTORY_COUNT = 1;
+
+/* A logical address shifted by this amount is the index of its entry in the page directory. */
+static const int DIRECTORY_SHIFT = 22;
+
+static const int PHYSICAL_ADDRESS_BITS = 32;
+#endif
 
-/* Don't mess with memory below 1M or above 4G. */
+/* Number of entries in all of the page directories of an address space. */
+static const page_table_idx_t DIRECTORY_ENTRY_COUNT = PAGE_DIRECTORY_COUNT * PAGE_ENTRY_COUNT;
+
+/* Don't mess with memory below 1M or in the last frame. */
 static const physical_address_t USABLE_MEMORY_BEGIN = 0x00100000;
-static const physical_address_t USABLE_MEMORY_END = 0xFFFFF000;
+static const uint64_t USABLE_MEMORY_END = (static_cast<uint64_t> (1) << PHYSICAL_ADDRESS_BITS) - PAGE_SIZE;
+
+/* Frames below this frame have 32-bit physical addresses. */
+static const frame_t LOW_FRAME_END = 0x00100000;
 
 /* Should agree with loader.s. */
 static const logical_address_t KERNEL_VIRTUAL_BASE = 0xC0000000;
@@ -30,11 +64,11 @@ static const logical_address_t INITIAL_LOGICAL_LIMIT = 0xC0400000;
 // One megabyte is important for dealing with low memory.
 static const size_t ONE_MEGABYTE = 0x00100000;
 
-// Four megabytes are important because that is span of one page table or page directory entry.
-static const size_t FOUR_MEGABYTES = 0x00400000;
+// The span of one page directory entry which is also the size of a large page, i.e., 4MB or 2MB with PAE.
+static const size_t LARGE_PAGE_SIZE = static_cast<size_t> (1) << DIRECTORY_SHIFT;
 
 /* Logical address above this address are using for page tables. */
-static const logical_address_t PAGING_AREA = 0xFFC00000;
+static const logical_address_t PAGING_AREA = -(PAGE_DIRECTORY_COUNT * LARGE_PAGE_SIZE);
 
 inline frame_t
 physical_address_to_frame (physical_address_t address)
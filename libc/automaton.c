@@ -100,6 +100,14 @@ finish (bool output_fired,
   syscall3 (LILY_SYSCALL_FINISH, output_fired, bda, bdb);
 }
 
+void
+finish_list (bool output_fired,
+	     const buffer_range_t* ranges,
+	     size_t count)
+{
+  syscall3 (LILY_SYSCALL_FINISH_LIST, output_fired, ranges, count);
+}
+
 void
 do_schedule (void);
 
@@ -107,14 +115,30 @@ void
 finish_input (bd_t bda,
 	      bd_t bdb)
 {
-  if (bda != -1) {
-    buffer_destroy (bda);
-  }
-  if (bdb != -1) {
-    buffer_destroy (bdb);
+  do_schedule ();
+  /* The kernel destroys bda and bdb when an input finishes. */
+  finish (0, bda, bdb);
+}
+
+void
+finish_input_list (const bd_t* bdv,
+		   size_t bdc)
+{
+  /* The kernel destroys the buffers named in the list when an input finishes.
+     An output never produces more than LILY_SYSCALL_FINISH_LIST_MAX buffers. */
+  buffer_range_t ranges[LILY_SYSCALL_FINISH_LIST_MAX];
+  size_t count = 0;
+  size_t idx;
+  for (idx = 0; idx != bdc && count != LILY_SYSCALL_FINISH_LIST_MAX; ++idx) {
+    if (bdv[idx] != -1) {
+      ranges[count].bd = bdv[idx];
+      ranges[count].begin = 0;
+      ranges[count].end = 0;
+      ++count;
+    }
   }
   do_schedule ();
-  finish (0, -1, -1);
+  finish_list (0, ranges, count);
 }
 
 void
@@ -126,6 +150,15 @@ finish_output (bool output_fired,
   finish (output_fired, bda, bdb);
 }
 
+void
+finish_output_list (bool output_fired,
+		    const buffer_range_t* ranges,
+		    size_t count)
+{
+  do_schedule ();
+  finish_list (output_fired, ranges, count);
+}
+
 void
 finish_internal (void)
 {
@@ -142,6 +175,15 @@ create (bd_t text_bd,
   return retval;
 }
 
+aid_t
+clone (aid_t aid,
+       bool retain_privilege)
+{
+  aid_t retval;
+  syscall2re (LILY_SYSCALL_CLONE, retval, lily_error, aid, retain_privilege);
+  return retval;
+}
+
 bid_t
 bind (aid_t output_automaton,
       ano_t output_action,
@@ -291,6 +333,27 @@ buffer_unmap (bd_t bd)
   return retval;
 }
 
+bd_t
+buffer_copy_range (bd_t bd,
+		   size_t begin,
+		   size_t end)
+{
+  bd_t retval;
+  syscall3re (LILY_SYSCALL_BUFFER_COPY_RANGE, retval, lily_error, bd, begin, end);
+  return retval;
+}
+
+size_t
+buffer_append_range (bd_t dest,
+		     bd_t src,
+		     size_t begin,
+		     size_t end)
+{
+  size_t retval;
+  syscall4re (LILY_SYSCALL_BUFFER_APPEND_RANGE, retval, lily_error, dest, src, begin, end);
+  return retval;
+}
+
 long
 sysconf (int name)
 {
@@ -352,6 +415,24 @@ get_boot_data (void)
   return retval;
 }
 
+int
+get_memory_stats (aid_t aid,
+		  memory_stats_t* stats)
+{
+  int retval;
+  syscall2re (LILY_SYSCALL_GET_MEMORY_STATS, retval, lily_error, aid, stats);
+  return retval;
+}
+
+int
+set_memory_quota (aid_t aid,
+		  size_t page_count)
+{
+  int retval;
+  syscall2re (LILY_SYSCALL_SET_MEMORY_QUOTA, retval, lily_error, aid, page_count);
+  return retval;
+}
+
 int
 map (const void* destination,
      const void* source,
@@ -455,6 +536,14 @@ unsubscribe_irq (int irq)
   return retval;
 }
 
+int
+print_slab_statistics (void)
+{
+  int retval;
+  syscall0re (LILY_SYSCALL_PRINT_SLAB_STATISTICS, retval, lily_error);
+  return retval;
+}
+
 const char*
 lily_error_string (lily_error_t err)
 {
@@ -38,6 +38,15 @@ void func (ano, param, bda, bdb);					\
 EMBED_ACTION_DESCRIPTOR (LILY_ACTION_INPUT, parameter_mode, func, action_no, action_name, action_desc); \
 void func (ano, param, bda, bdb)
 
+/* Inputs also receive the complete list of buffers produced by the output.
+   bda and bdb are the first two elements of the list (or -1).
+   Use finish_input_list to destroy all of them.
+   An input declared with BEGIN_INPUT that finishes with finish_input has the rest of the list destroyed by the kernel. */
+#define BEGIN_INPUT_LIST(parameter_mode, action_no, action_name, action_desc, func, ano, param, bda, bdb, bdv, bdc) \
+void func (ano, param, bda, bdb, bdv, bdc);				\
+EMBED_ACTION_DESCRIPTOR (LILY_ACTION_INPUT, parameter_mode, func, action_no, action_name, action_desc); \
+void func (ano, param, bda, bdb, bdv, bdc)
+
 #define BEGIN_OUTPUT(parameter_mode, action_no, action_name, action_desc, func, ano, param) \
 void func (ano, param);						\
 EMBED_ACTION_DESCRIPTOR (LILY_ACTION_OUTPUT, parameter_mode, func, action_no, action_name, action_desc); \
@@ -59,6 +68,8 @@ int
 schedule (ano_t action_number,
 	  int parameter);
 
+/* For outputs, bda and bdb are the buffers to send.
+   For inputs, bda and bdb are destroyed if they are not -1. */
 void
 finish (bool output_fired,
 	bd_t bda,
@@ -73,6 +84,22 @@ finish_output (bool output_fired,
 	       bd_t bda,
 	       bd_t bdb);
 
+/* Finish with up to LILY_SYSCALL_FINISH_LIST_MAX page ranges of buffers.
+   Each range is delivered to the inputs as a separate buffer. */
+void
+finish_list (bool output_fired,
+	     const buffer_range_t* ranges,
+	     size_t count);
+
+void
+finish_input_list (const bd_t* bdv,
+		   size_t bdc);
+
+void
+finish_output_list (bool output_fired,
+		    const buffer_range_t* ranges,
+		    size_t count);
+
 void
 finish_internal (void);
 
@@ -80,6 +107,12 @@ aid_t
 create (bd_t text_bd,
 	bool retain_privilege);
 
+/* Create an automaton that is a copy-on-write copy of an existing automaton.
+   Only a privileged automaton can clone. */
+aid_t
+clone (aid_t aid,
+       bool retain_privilege);
+
 bid_t
 bind (aid_t output_automaton,
       ano_t output_action,
@@ -139,6 +172,19 @@ buffer_map (bd_t bd);
 int
 buffer_unmap (bd_t bd);
 
+/* Copy or append the pages [begin, end) of a buffer.
+   The pages are shared copy-on-write with the source. */
+bd_t
+buffer_copy_range (bd_t bd,
+		   size_t begin,
+		   size_t end);
+
+size_t
+buffer_append_range (bd_t dest,
+		     bd_t src,
+		     size_t begin,
+		     size_t end);
+
 #define SYSCONF_PAGESIZE LILY_SYSCALL_SYSCONF_PAGESIZE
 
 long
@@ -164,6 +210,17 @@ getmonotime (mono_time_t* t);
 bd_t
 get_boot_data (void);
 
+/* Page counts for an automaton.  See memory_stats_t. */
+int
+get_memory_stats (aid_t aid,
+		  memory_stats_t* stats);
+
+/* Limit the heap, stack, and buffers of an automaton to page_count pages.
+   An unprivileged automaton can only lower its own quota. */
+int
+set_memory_quota (aid_t aid,
+		  size_t page_count);
+
 /* These calls can only be made by privileged automata. */
 int
 map (const void* destination,
@@ -208,6 +265,10 @@ subscribe_irq (int irq,
 int
 unsubscribe_irq (int irq);
 
+/* Print the kernel's slab cache statistics on the console. */
+int
+print_slab_statistics (void);
+
 const char*
 lily_error_string (lily_error_t err);
 
@@ -0,0 +1,197 @@
+#include "lz4.h"
+#include "automaton.h"
+#include "string.h"
+
+/* Read the extended part of a length.
+   Returns -1 if the input ends. */
+static int
+read_length (const unsigned char** ip,
+	     const unsigned char* iend,
+	     size_t* length)
+{
+  unsigned int b;
+  do {
+    if (*ip == iend) {
+      return -1;
+    }
+    b = *(*ip)++;
+    *length += b;
+  } while (b == 255);
+
+  return 0;
+}
+
+int
+lz4_decompress_block (const void* src,
+		      size_t src_size,
+		      void* dst,
+		      size_t dst_size)
+{
+  const unsigned char* ip = src;
+  const unsigned char* const iend = ip + src_size;
+  unsigned char* op = dst;
+  unsigned char* const oend = op + dst_size;
+
+  while (ip != iend) {
+    const unsigned int token = *ip++;
+
+    /* Literals. */
+    size_t length = token >> 4;
+    if (length == 15 && read_length (&ip, iend, &length) != 0) {
+      return -1;
+    }
+    if (length > (size_t)(iend - ip) || length > (size_t)(oend - op)) {
+      return -1;
+    }
+    memcpy (op, ip, length);
+    ip += length;
+    op += length;
+
+    if (ip == iend) {
+      /* The last sequence has no match. */
+      break;
+    }
+
+    /* Match. */
+    if (iend - ip < 2) {
+      return -1;
+    }
+    const size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - (unsigned char*)dst)) {
+      return -1;
+    }
+
+    length = token & 15;
+    if (length == 15 && read_length (&ip, iend, &length) != 0) {
+      return -1;
+    }
+    length += 4;
+    if (length > (size_t)(oend - op)) {
+      return -1;
+    }
+
+    /* The match may overlap the output so copy a byte at a time. */
+    const unsigned char* match = op - offset;
+    while (length-- != 0) {
+      *op++ = *match++;
+    }
+  }
+
+  return op - (unsigned char*)dst;
+}
+
+int
+lz4_stream_init (lz4_stream_t* s,
+		 bd_t bd)
+{
+  if (buffer_file_initr (&s->bf, bd) != 0) {
+    return -1;
+  }
+
+  const char* magic = buffer_file_readp (&s->bf, 4);
+  if (magic == 0 || memcmp (magic, LZ4_MAGIC, 4) != 0) {
+    return -1;
+  }
+
+  const unsigned int* size = buffer_file_readp (&s->bf, sizeof (unsigned int));
+  if (size == 0) {
+    return -1;
+  }
+
+  /* The decompressed buffer file also holds its size. */
+  if (*size > (size_t)-1 - sizeof (size_t)) {
+    return -1;
+  }
+
+  s->size = *size;
+  s->position = 0;
+
+  return 0;
+}
+
+int
+lz4_stream_read (lz4_stream_t* s,
+		 void* dst)
+{
+  if (s->position == s->size) {
+    return 0;
+  }
+
+  const unsigned int* header = buffer_file_readp (&s->bf, sizeof (unsigned int));
+  if (header == 0) {
+    return -1;
+  }
+
+  const size_t src_size = *header & ~LZ4_STORED;
+  const void* src = buffer_file_readp (&s->bf, src_size);
+  if (src == 0) {
+    return -1;
+  }
+
+  size_t dst_size = s->size - s->position;
+  if (dst_size > LZ4_BLOCK_SIZE) {
+    dst_size = LZ4_BLOCK_SIZE;
+  }
+
+  if ((*header & LZ4_STORED) != 0) {
+    if (src_size != dst_size) {
+      return -1;
+    }
+    memcpy (dst, src, src_size);
+  }
+  else if (lz4_decompress_block (src, src_size, dst, dst_size) != dst_size) {
+    return -1;
+  }
+
+  s->position += dst_size;
+  return dst_size;
+}
+
+bool
+lz4_is_compressed (bd_t bd)
+{
+  lz4_stream_t s;
+  return lz4_stream_init (&s, bd) == 0;
+}
+
+bd_t
+lz4_decompress_buffer (bd_t bd)
+{
+  lz4_stream_t s;
+  if (lz4_stream_init (&s, bd) != 0) {
+    return -1;
+  }
+
+  /* The uncompressed contents follow the size of the buffer file. */
+  const size_t total = sizeof (size_t) + s.size;
+  bd_t out = buffer_create (size_to_pages (total));
+  if (out == -1) {
+    return -1;
+  }
+  char* ptr = buffer_map (out);
+  if (ptr == 0) {
+    buffer_destroy (out);
+    return -1;
+  }
+  *((size_t*)ptr) = total;
+
+  /* Decompress one block at a time.
+     Pages of the new buffer are touched in order as they are filled. */
+  char* dst = ptr + sizeof (size_t);
+  int n;
+  while ((n = lz4_stream_read (&s, dst)) > 0) {
+    dst += n;
+  }
+  if (n != 0) {
+    buffer_destroy (out);
+    return -1;
+  }
+
+  if (buffer_unmap (out) != 0) {
+    buffer_destroy (out);
+    return -1;
+  }
+
+  return out;
+}
@@ -0,0 +1,60 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <lily/types.h>
+#include <buffer_file.h>
+
+/* LZ4 Archives
+   ============
+   A buffer file can be compressed with the LZ4 block format to reduce the size of the boot data.
+
+   The contents of a compressed buffer file are:
+   1.  The magic number LZ4_MAGIC.
+   2.  The size of the uncompressed contents (4 bytes).
+   3.  A sequence of blocks.
+
+   Each block begins with a 4-byte header containing the size of the block.
+   If LZ4_STORED is set in the header, the block is stored uncompressed.
+   Every block except the last decompresses to LZ4_BLOCK_SIZE bytes.
+   Blocks are independent so they can be decompressed one at a time directly into their destination.
+*/
+
+#define LZ4_MAGIC "LZ4A"
+#define LZ4_BLOCK_SIZE 65536
+#define LZ4_STORED 0x80000000
+
+/* Decompress a block of size src_size at src into dst.
+   Returns the number of bytes written or -1 if the block is corrupt or does not fit in dst_size bytes. */
+int
+lz4_decompress_block (const void* src,
+		      size_t src_size,
+		      void* dst,
+		      size_t dst_size);
+
+typedef struct {
+  buffer_file_t bf;
+  size_t size;		/* Size of the uncompressed contents. */
+  size_t position;	/* Number of bytes decompressed. */
+} lz4_stream_t;
+
+/* Returns -1 if the buffer file is not compressed. */
+int
+lz4_stream_init (lz4_stream_t* s,
+		 bd_t bd);
+
+/* Decompress the next block into dst which must have room for LZ4_BLOCK_SIZE bytes.
+   Returns the number of bytes written, 0 at the end of the stream, or -1 on error. */
+int
+lz4_stream_read (lz4_stream_t* s,
+		 void* dst);
+
+bool
+lz4_is_compressed (bd_t bd);
+
+/* Returns a new buffer file with the uncompressed contents of a compressed buffer file. */
+bd_t
+lz4_decompress_buffer (bd_t bd);
+
+#endif /* LZ4_H */
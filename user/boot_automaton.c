@@ -2,6 +2,7 @@
 #include <description.h>
 #include <dymem.h>
 #include <string.h>
+#include <lz4.h>
 #include "cpio.h"
 #include "de.h"
 #include "environment.h"
@@ -13,7 +14,8 @@
   The boot automaton is the first automaton loaded and consequently has the responsibility of creating an environment for loading additional automata.
   This environment consists of a temporary file system (tmpfs) and another automaton (typically a shell called jsh) from which the rest of the system can be loaded.
   The boot automaton receives a buffer containing a cpio archive that it uses to create these two automata.
-  It passes the archive to the tmpfs automaton.
+  The archive may be compressed (see lz4.h) in which case the boot automaton decompresses it first.
+  It passes the uncompressed archive to the tmpfs automaton.
 
   Authors:  Justin R. Wilson
   Copyright (C) 2012 Justin R. Wilson
@@ -62,6 +64,8 @@ jsh_callback (void* arg,
     logs (log_buffer);
     exit (-1);
   }
+
+  system_profile (&system, "jsh created");
 }
 
 static void
@@ -75,6 +79,8 @@ tmpfs_callback (void* arg,
     exit (-1);
   }
 
+  system_profile (&system, "tmpfs created");
+
   /* Form the init buffer of the jsh. */
   bd_t de_bd = buffer_create (0);
   if (de_bd == -1) {
@@ -125,6 +131,8 @@ initialize (void)
       logs (log_buffer);
       exit (-1);
     }
+
+    system_profile (&system, "boot automaton initialized");
   }
 }
 
@@ -134,6 +142,18 @@ load (bd_t bda)
   if (!loaded) {
     loaded = true;
 
+    bd_t archive_bd = -1;
+    if (bda != -1 && lz4_is_compressed (bda)) {
+      archive_bd = lz4_decompress_buffer (bda);
+      if (archive_bd == -1) {
+	snprintf (log_buffer, LOG_BUFFER_SIZE, ERROR "could not decompress boot data: %s", lily_error_string (lily_error));
+	logs (log_buffer);
+	exit (-1);
+      }
+      bda = archive_bd;
+      system_profile (&system, "boot data decompressed");
+    }
+
     if (bda != -1) {
       cpio_archive_t archive;
       if (cpio_archive_init (&archive, bda) != 0) {
@@ -178,6 +198,8 @@ load (bd_t bda)
       	exit (-1);
       }
 
+      system_profile (&system, "boot data scanned");
+
       /* Create the tmpfs. */
       automaton_t* tmpfs = system_create (&system, tmpfs_bd, false, bda, -1, tmpfs_callback, 0);
 
@@ -186,6 +208,12 @@ load (bd_t bda)
       	logs (log_buffer);
       	exit (-1);
       }
+
+      if (archive_bd != -1 && buffer_destroy (archive_bd) != 0) {
+      	snprintf (log_buffer, LOG_BUFFER_SIZE, ERROR "could not destroy decompressed boot data: %s", lily_error_string (lily_error));
+      	logs (log_buffer);
+      	exit (-1);
+      }
     }
     else {
       snprintf (log_buffer, LOG_BUFFER_SIZE, WARNING "no initialization data");
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+  Compress a file with the LZ4 block format for use as a compressed buffer file.
+  See lz4.h in libc for the format.
+  The output begins with four bytes reserved for to_buffer_file.
+
+  Authors:  Justin R. Wilson
+*/
+
+#define LZ4_MAGIC "LZ4A"
+#define LZ4_BLOCK_SIZE 65536
+#define LZ4_STORED 0x80000000
+
+#define HASH_LOG 14
+#define MIN_MATCH 4
+/* The last match must start at least 12 bytes before the end of the block. */
+#define MF_LIMIT 12
+/* The last 5 bytes of a block are literals. */
+#define LAST_LITERALS 5
+#define MAX_OFFSET 65535
+
+static uint32_t
+read32 (const unsigned char* p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static unsigned int
+hash (uint32_t sequence)
+{
+  return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static unsigned char*
+write_length (unsigned char* op,
+	      size_t length)
+{
+  while (length >= 255) {
+    *op++ = 255;
+    length -= 255;
+  }
+  *op++ = length;
+  return op;
+}
+
+static unsigned char*
+write_sequence (unsigned char* op,
+		const unsigned char* literals,
+		size_t literal_length,
+		size_t offset,
+		size_t match_length)
+{
+  unsigned char* token = op++;
+  *token = (literal_length < 15 ? literal_length : 15) << 4;
+  if (literal_length >= 15) {
+    op = write_length (op, literal_length - 15);
+  }
+  memcpy (op, literals, literal_length);
+  op += literal_length;
+
+  if (match_length != 0) {
+    *op++ = offset & 0xFF;
+    *op++ = offset >> 8;
+    match_length -= MIN_MATCH;
+    *token |= match_length < 15 ? match_length : 15;
+    if (match_length >= 15) {
+      op = write_length (op, match_length - 15);
+    }
+  }
+
+  return op;
+}
+
+/* Greedy compression with a hash table of the last position of each 4-byte sequence. */
+static size_t
+compress_block (const unsigned char* src,
+		size_t size,
+		unsigned char* dst)
+{
+  static uint32_t table[1 << HASH_LOG];
+  memset (table, 0xFF, sizeof (table));
+
+  unsigned char* op = dst;
+  size_t anchor = 0;
+  size_t pos = 0;
+
+  while (pos + MF_LIMIT <= size) {
+    const uint32_t sequence = read32 (src + pos);
+    const unsigned int h = hash (sequence);
+    const uint32_t candidate = table[h];
+    table[h] = pos;
+
+    if (candidate != 0xFFFFFFFF && pos - candidate <= MAX_OFFSET && read32 (src + candidate) == sequence) {
+      size_t length = MIN_MATCH;
+      while (pos + length < size - LAST_LITERALS && src[candidate + length] == src[pos + length]) {
+	++length;
+      }
+      op = write_sequence (op, src + anchor, pos - anchor, pos - candidate, length);
+      pos += length;
+      anchor = pos;
+    }
+    else {
+      ++pos;
+    }
+  }
+
+  return write_sequence (op, src + anchor, size - anchor, 0, 0) - dst;
+}
+
+static void
+write_or_die (const void* ptr,
+	      size_t size,
+	      FILE* out,
+	      const char* filename)
+{
+  if (fwrite (ptr, 1, size, out) != size) {
+    fprintf (stderr, "Could not write to %s: %s\n", filename, strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+}
+
+int
+main (int argc,
+      char** argv)
+{
+  if (argc != 3) {
+    fprintf (stderr, "Usage: %s INPUT OUTPUT\n", argv[0]);
+    exit (EXIT_FAILURE);
+  }
+
+  FILE* in = fopen (argv[1], "rb");
+  if (in == 0) {
+    fprintf (stderr, "Could not open %s: %s\n", argv[1], strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+
+  FILE* out = fopen (argv[2], "wb");
+  if (out == 0) {
+    fprintf (stderr, "Could not open %s: %s\n", argv[2], strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+
+  if (fseek (in, 0, SEEK_END) != 0) {
+    fprintf (stderr, "Could not seek in %s: %s\n", argv[1], strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+  const uint32_t size = ftell (in);
+  rewind (in);
+
+  /* Reserved for to_buffer_file. */
+  write_or_die ("xxxx", 4, out, argv[2]);
+  write_or_die (LZ4_MAGIC, 4, out, argv[2]);
+  write_or_die (&size, sizeof (size), out, argv[2]);
+
+  static unsigned char block[LZ4_BLOCK_SIZE];
+  /* The worst case for incompressible data. */
+  static unsigned char compressed[LZ4_BLOCK_SIZE + LZ4_BLOCK_SIZE / 255 + 16];
+  size_t total = 0;
+
+  size_t count;
+  while ((count = fread (block, 1, LZ4_BLOCK_SIZE, in)) != 0) {
+    size_t compressed_size = compress_block (block, count, compressed);
+    uint32_t header;
+    if (compressed_size < count) {
+      header = compressed_size;
+      write_or_die (&header, sizeof (header), out, argv[2]);
+      write_or_die (compressed, compressed_size, out, argv[2]);
+    }
+    else {
+      header = count | LZ4_STORED;
+      compressed_size = count;
+      write_or_die (&header, sizeof (header), out, argv[2]);
+      write_or_die (block, count, out, argv[2]);
+    }
+    total += compressed_size + sizeof (header);
+  }
+
+  fclose (in);
+  fclose (out);
+
+  printf ("%s: %u -> %zu bytes\n", argv[2], size, total);
+
+  exit (EXIT_SUCCESS);
+}
@@ -0,0 +1,123 @@
+#include "unordered_set.hpp"
+#include "linear_set.hpp"
+#include <stdio.h>
+#include <time.h>
+
+/*
+  Benchmark the kernel's open-addressing unordered_set against the chained linear_set built on the host.
+
+  Both containers use the kernel's slab allocator.
+  Each round inserts COUNT keys, finds each of them, looks up COUNT keys that are absent, and erases the keys.
+  Keys are either consecutive integers like automaton and buffer identifiers or spaced like pointers to kernel objects.
+  The results are nanoseconds per operation so the two containers can be compared for each size.
+
+  Authors:  Justin R. Wilson
+*/
+
+/* Operations per measurement for each phase. */
+#define OPERATION_TARGET 4000000
+/* Minimum operations between readings of the clock. */
+#define BATCH_OPERATIONS 65536
+
+typedef unordered_set<unsigned long> open_set;
+typedef linear_set<unsigned long> chained_set;
+
+static inline bool
+add (open_set& s,
+     unsigned long key)
+{
+  return s.insert (key).second;
+}
+
+static inline bool
+add (chained_set& s,
+     unsigned long key)
+{
+  return s.push_back (key);
+}
+
+static double
+ns_per_operation (clock_t time,
+		  size_t operations)
+{
+  return (double)time / CLOCKS_PER_SEC * 1e9 / operations;
+}
+
+/* Prevents the compiler from discarding the lookups. */
+static volatile size_t found_count = 0;
+
+template <typename Set>
+static void
+bench (const char* name,
+       const char* pattern,
+       size_t count,
+       unsigned long stride)
+{
+  /* Small tables are measured in batches so the clock is read once per BATCH_OPERATIONS operations. */
+  const size_t batch = (count < BATCH_OPERATIONS) ? BATCH_OPERATIONS / count : 1;
+  const size_t batches = OPERATION_TARGET / (batch * count);
+  clock_t insert_time = 0;
+  clock_t hit_time = 0;
+  clock_t miss_time = 0;
+  clock_t erase_time = 0;
+
+  for (size_t b = 0; b != batches; ++b) {
+    Set* sets = new Set[batch];
+    clock_t t0 = clock ();
+    for (size_t i = 0; i != batch; ++i) {
+      for (size_t k = 0; k != count; ++k) {
+	add (sets[i], 0x1000 + k * stride);
+      }
+    }
+    clock_t t1 = clock ();
+    for (size_t i = 0; i != batch; ++i) {
+      for (size_t k = 0; k != count; ++k) {
+	found_count += (sets[i].find (0x1000 + k * stride) != sets[i].end ());
+      }
+    }
+    clock_t t2 = clock ();
+    for (size_t i = 0; i != batch; ++i) {
+      for (size_t k = 0; k != count; ++k) {
+	found_count += (sets[i].find (0x1000 + (count + k) * stride) != sets[i].end ());
+      }
+    }
+    clock_t t3 = clock ();
+    for (size_t i = 0; i != batch; ++i) {
+      for (size_t k = 0; k != count; ++k) {
+	sets[i].erase (0x1000 + k * stride);
+      }
+    }
+    clock_t t4 = clock ();
+    delete[] sets;
+
+    insert_time += t1 - t0;
+    hit_time += t2 - t1;
+    miss_time += t3 - t2;
+    erase_time += t4 - t3;
+  }
+
+  const size_t operations = batches * batch * count;
+  printf ("%-8s %-8s %8zu %8.1f %8.1f %8.1f %8.1f\n",
+	  name, pattern, count,
+	  ns_per_operation (insert_time, operations),
+	  ns_per_operation (hit_time, operations),
+	  ns_per_operation (miss_time, operations),
+	  ns_per_operation (erase_time, operations));
+}
+
+int
+main (void)
+{
+  static const size_t counts[] = { 16, 256, 4096, 65536 };
+  static const size_t count_count = sizeof (counts) / sizeof (counts[0]);
+
+  printf ("%-8s %-8s %8s %8s %8s %8s %8s\n", "table", "keys", "count", "insert", "hit", "miss", "erase");
+  for (size_t idx = 0; idx != count_count; ++idx) {
+    bench<open_set> ("open", "dense", counts[idx], 1);
+    bench<chained_set> ("chained", "dense", counts[idx], 1);
+    bench<open_set> ("open", "pointer", counts[idx], 64);
+    bench<chained_set> ("chained", "pointer", counts[idx], 64);
+  }
+
+  return 0;
+}
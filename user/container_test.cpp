@@ -0,0 +1,166 @@
+#include "unordered_map.hpp"
+#include "unordered_set.hpp"
+#include <stdio.h>
+
+/*
+  Stress test for the kernel's open-addressing unordered_map and unordered_set built on the host.
+
+  Random inserts, erases, and finds are checked against a reference array.
+  Periodically, the test also checks iteration, copying, and erasing while iterating.
+  The keys are drawn from a small range so that the tables grow, migrate, and fill with deleted slots.
+  <stdlib.h> is not used because its integer types conflict with the kernel's.
+
+  Authors:  Justin R. Wilson
+*/
+
+#define KEY_LIMIT 4096
+#define OPERATION_COUNT 2000000
+#define CHECK_INTERVAL 65536
+
+#define CHECK(expr) do { if (!(expr)) { fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); __builtin_abort (); } } while (0)
+
+typedef unordered_map<int, int> map_type;
+typedef unordered_set<int> set_type;
+
+static bool present[KEY_LIMIT];
+static int value[KEY_LIMIT];
+static size_t present_count = 0;
+
+/* A fixed generator so failures can be reproduced. */
+static unsigned int seed = 1;
+
+static unsigned int
+random_next (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+/* Every value of the map is visited exactly once and matches the reference. */
+static void
+check_map (const map_type& m)
+{
+  static bool seen[KEY_LIMIT];
+  for (size_t k = 0; k != KEY_LIMIT; ++k) {
+    seen[k] = false;
+  }
+
+  size_t count = 0;
+  for (map_type::const_iterator pos = m.begin (); pos != m.end (); ++pos) {
+    const int k = pos->first;
+    CHECK (k >= 0 && k < KEY_LIMIT);
+    CHECK (present[k]);
+    CHECK (!seen[k]);
+    CHECK (pos->second == value[k]);
+    seen[k] = true;
+    ++count;
+  }
+  CHECK (count == present_count);
+  CHECK (m.size () == present_count);
+}
+
+static void
+check_set (const set_type& s)
+{
+  size_t count = 0;
+  for (set_type::const_iterator pos = s.begin (); pos != s.end (); ++pos) {
+    CHECK (*pos >= 0 && *pos < KEY_LIMIT);
+    CHECK (present[*pos]);
+    ++count;
+  }
+  CHECK (count == present_count);
+  CHECK (s.size () == present_count);
+}
+
+/* Erase the odd keys of a copy while iterating over it. */
+static void
+check_erase_while_iterating (const set_type& s)
+{
+  set_type copy (s);
+  for (set_type::const_iterator pos = copy.begin (); pos != copy.end (); ++pos) {
+    if (*pos % 2 != 0) {
+      copy.erase (pos);
+    }
+  }
+
+  size_t even_count = 0;
+  for (size_t k = 0; k != KEY_LIMIT; k += 2) {
+    if (present[k]) {
+      CHECK (copy.find (k) != copy.end ());
+      ++even_count;
+    }
+    if (k + 1 != KEY_LIMIT) {
+      CHECK (copy.find (k + 1) == copy.end ());
+    }
+  }
+  CHECK (copy.size () == even_count);
+}
+
+int
+main (void)
+{
+  map_type m;
+  set_type s;
+
+  for (size_t op = 0; op != OPERATION_COUNT; ++op) {
+    const unsigned int r = random_next ();
+    const int k = r % KEY_LIMIT;
+    switch ((r / KEY_LIMIT) % 3) {
+    case 0:
+      {
+	const int v = random_next ();
+	pair<map_type::iterator, bool> mr = m.insert (make_pair (k, v));
+	pair<set_type::iterator, bool> sr = s.insert (k);
+	CHECK (mr.second == !present[k]);
+	CHECK (sr.second == !present[k]);
+	CHECK (mr.first->first == k);
+	CHECK (*sr.first == k);
+	if (!present[k]) {
+	  present[k] = true;
+	  value[k] = v;
+	  ++present_count;
+	}
+	CHECK (mr.first->second == value[k]);
+      }
+      break;
+    case 1:
+      CHECK (m.erase (k) == (present[k] ? 1U : 0U));
+      CHECK (s.erase (k) == (present[k] ? 1U : 0U));
+      if (present[k]) {
+	present[k] = false;
+	--present_count;
+      }
+      break;
+    case 2:
+      {
+	map_type::const_iterator pos = m.find (k);
+	CHECK ((pos != m.end ()) == present[k]);
+	CHECK (pos == m.end () || pos->second == value[k]);
+	CHECK ((s.find (k) != s.end ()) == present[k]);
+      }
+      break;
+    }
+    CHECK (m.size () == present_count);
+    CHECK (s.size () == present_count);
+
+    if (op % CHECK_INTERVAL == 0) {
+      check_map (m);
+      check_set (s);
+      map_type map_copy (m);
+      check_map (map_copy);
+      check_erase_while_iterating (s);
+    }
+  }
+
+  m.clear ();
+  s.clear ();
+  for (size_t k = 0; k != KEY_LIMIT; ++k) {
+    present[k] = false;
+  }
+  present_count = 0;
+  check_map (m);
+  check_set (s);
+
+  printf ("%d operations passed\n", OPERATION_COUNT);
+  return 0;
+}
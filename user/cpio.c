@@ -93,6 +93,8 @@ cpio_archive_read (cpio_archive_t* ar,
     /* Name is not null terminated. */
     return -1;
   }
+  /* A page-aligned archive pads the name with null characters so the data starts on a page boundary. */
+  f->name_size = strlen (f->name) + 1;
 
   /* Check for the trailer. */
   if (strcmp (f->name, "TRAILER!!!") == 0) {
@@ -121,6 +123,14 @@ bd_t
 cpio_file_read (cpio_archive_t* ar,
 		const cpio_file_t* f)
 {
+  /* Positions in a buffer file do not include the size at the beginning of the buffer. */
+  const size_t offset = f->position + sizeof (size_t);
+  if (offset % pagesize () == 0) {
+    /* The data starts on a page boundary so the file can share the pages of the archive. */
+    const size_t begin = offset / pagesize ();
+    return buffer_copy_range (ar->bf.bd, begin, begin + size_to_pages (f->file_size));
+  }
+
   /* Get the current position. */
   size_t position = buffer_file_position (&ar->bf);
 
@@ -39,6 +39,8 @@ int
 cpio_archive_read (cpio_archive_t* ar,
 		   cpio_file_t* f);
 
+/* Returns a buffer containing the contents of the file.
+   If the data is page-aligned in the archive, the buffer shares pages with the archive and the last page may contain bytes beyond the end of the file. */
 bd_t
 cpio_file_read (cpio_archive_t* ar,
 		const cpio_file_t* f);
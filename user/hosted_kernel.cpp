@@ -0,0 +1,36 @@
+/*
+  File
+  ----
+  hosted_kernel.cpp
+
+  Description
+  -----------
+  The kernel services used by the kernel containers when they are built on the host.
+  The containers themselves are the kernel headers, unmodified.
+
+  Authors:
+  Justin R. Wilson
+*/
+
+#include "slab_allocator.hpp"
+
+void
+slab_cache::grow ()
+{
+  // Slabs are never freed.
+  char* slab = static_cast<char*> (::operator new (SLAB_SIZE));
+
+  if (slab_count == 0) {
+    next = cache_list;
+    cache_list = this;
+  }
+  ++slab_count;
+
+  for (size_t offset = 0; offset + object_size <= SLAB_SIZE; offset += object_size) {
+    free_object* obj = reinterpret_cast<free_object*> (slab + offset);
+    obj->next = free_list;
+    free_list = obj;
+  }
+}
+
+slab_cache* slab_cache::cache_list = 0;
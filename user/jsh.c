@@ -1143,6 +1143,7 @@ readscript_callback (void* arg,
       }
       interpret (str, res->size);
       buffer_unmap (bd);
+      system_profile (&system, "start script interpreted");
     }
     break;
   case FS_READFILE_BAD_START:
@@ -1178,6 +1179,7 @@ BEGIN_INPUT (NO_PARAMETER, INIT_NO, SA_INIT_IN_NAME, "", init, ano_t ano, int pa
       logs (log_buffer);
       exit (-1);
     }
+    system_profile (&system, "jsh initialized");
     fs_set_init (&fs_set, &system, &output_bfa, FS_DESCEND_REQUEST_OUT_NO, FS_DESCEND_RESPONSE_IN_NO, FS_READFILE_REQUEST_OUT_NO, FS_READFILE_RESPONSE_IN_NO);
 
     //this_automaton = create_automaton (system_get_this (&system), "this", 0);
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+  Rewrite a newc cpio archive so the data of every regular file starts on a page boundary of the boot data buffer.
+  The data is aligned by padding the name of the file with null characters so the result is still a valid newc archive.
+  cpio_file_read shares the pages of an aligned file with the archive instead of copying it.
+
+  The output does not include the four bytes reserved for to_buffer_file but the alignment accounts for them.
+  Consequently, the data of an aligned file is at a buffer_file position that is four bytes short of a page boundary.
+
+  Authors:  Justin R. Wilson
+*/
+
+#define PAGE_SIZE 4096
+/* Size of the buffer file header on the target. */
+#define HEADER_SIZE 4
+#define CPIO_HEADER_SIZE 110
+#define CPIO_TYPE_MASK 0x0000F000
+#define CPIO_REGULAR   0x00008000
+
+static size_t
+align_up (size_t value,
+	  size_t radix)
+{
+  return (value + radix - 1) & ~(radix - 1);
+}
+
+static unsigned int
+from_hex (const char* s)
+{
+  char buf[9];
+  memcpy (buf, s, 8);
+  buf[8] = 0;
+  return strtoul (buf, 0, 16);
+}
+
+static void
+write_or_die (const void* ptr,
+	      size_t size,
+	      FILE* out,
+	      const char* filename)
+{
+  if (fwrite (ptr, 1, size, out) != size) {
+    fprintf (stderr, "Could not write to %s: %s\n", filename, strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+}
+
+static void
+pad_or_die (size_t count,
+	    FILE* out,
+	    const char* filename)
+{
+  static const char zeros[PAGE_SIZE];
+  write_or_die (zeros, count, out, filename);
+}
+
+int
+main (int argc,
+      char** argv)
+{
+  if (argc != 3) {
+    fprintf (stderr, "Usage: %s INPUT OUTPUT\n", argv[0]);
+    exit (EXIT_FAILURE);
+  }
+
+  FILE* in = fopen (argv[1], "rb");
+  if (in == 0) {
+    fprintf (stderr, "Could not open %s: %s\n", argv[1], strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+
+  if (fseek (in, 0, SEEK_END) != 0) {
+    fprintf (stderr, "Could not seek in %s: %s\n", argv[1], strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+  const size_t size = ftell (in);
+  rewind (in);
+
+  char* archive = malloc (size);
+  if (archive == 0 || fread (archive, 1, size, in) != size) {
+    fprintf (stderr, "Could not read %s\n", argv[1]);
+    exit (EXIT_FAILURE);
+  }
+  fclose (in);
+
+  FILE* out = fopen (argv[2], "wb");
+  if (out == 0) {
+    fprintf (stderr, "Could not open %s: %s\n", argv[2], strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+
+  size_t in_pos = 0;
+  size_t out_pos = 0;
+  for (;;) {
+    in_pos = align_up (in_pos, 4);
+    if (in_pos + CPIO_HEADER_SIZE > size) {
+      fprintf (stderr, "%s: truncated header\n", argv[1]);
+      exit (EXIT_FAILURE);
+    }
+
+    char* header = archive + in_pos;
+    if (memcmp (header, "070701", 6) != 0 && memcmp (header, "070702", 6) != 0) {
+      fprintf (stderr, "%s: bad magic number\n", argv[1]);
+      exit (EXIT_FAILURE);
+    }
+    const unsigned int mode = from_hex (header + 14);
+    const size_t file_size = from_hex (header + 54);
+    const size_t name_size = from_hex (header + 94);
+    const char* name = header + CPIO_HEADER_SIZE;
+    const size_t data_pos = align_up (in_pos + CPIO_HEADER_SIZE + name_size, 4);
+    if (name_size == 0 || data_pos + file_size > size || name[name_size - 1] != 0) {
+      fprintf (stderr, "%s: truncated or corrupt entry\n", argv[1]);
+      exit (EXIT_FAILURE);
+    }
+
+    /* Pad the name so the data starts on a page boundary.
+       The padding is a multiple of four so the name and data remain aligned. */
+    size_t pad = 0;
+    if ((mode & CPIO_TYPE_MASK) == CPIO_REGULAR && file_size != 0) {
+      const size_t data_out = HEADER_SIZE + align_up (out_pos + CPIO_HEADER_SIZE + name_size, 4);
+      pad = align_up (data_out, PAGE_SIZE) - data_out;
+    }
+
+    char namesize[9];
+    snprintf (namesize, sizeof (namesize), "%08zX", name_size + pad);
+    memcpy (header + 94, namesize, 8);
+
+    write_or_die (header, CPIO_HEADER_SIZE, out, argv[2]);
+    write_or_die (name, name_size, out, argv[2]);
+    pad_or_die (pad, out, argv[2]);
+    out_pos += CPIO_HEADER_SIZE + name_size + pad;
+    pad_or_die (align_up (out_pos, 4) - out_pos, out, argv[2]);
+    out_pos = align_up (out_pos, 4);
+
+    write_or_die (archive + data_pos, file_size, out, argv[2]);
+    out_pos += file_size;
+    pad_or_die (align_up (out_pos, 4) - out_pos, out, argv[2]);
+    out_pos = align_up (out_pos, 4);
+
+    in_pos = data_pos + file_size;
+
+    if (strcmp (name, "TRAILER!!!") == 0) {
+      break;
+    }
+  }
+
+  free (archive);
+  fclose (out);
+
+  exit (EXIT_SUCCESS);
+}
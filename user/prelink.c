@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <elf.h>
+#include <lily/image.h>
+
+/*
+  Convert an automaton from ELF to a pre-linked image.
+  See lily/image.h in the kernel for the format.
+
+  The tool does the work the kernel would do when parsing the ELF file:
+  it lays out the pages of each loadable segment, merges pages shared by segments, zeroes uninitialized data, and collects the action descriptors from the notes.
+
+  Authors:  Justin R. Wilson
+*/
+
+#define PAGE_SIZE 4096
+#define MAX_SEGMENTS 16
+#define MAX_PAGES 16384
+
+/* Matches the action descriptor embedded by EMBED_ACTION_DESCRIPTOR. */
+typedef struct {
+  unsigned int action_type;
+  unsigned int parameter_mode;
+  unsigned int action_entry_point;
+  unsigned int action_number;
+  unsigned int action_name_size;
+  unsigned int action_description_size;
+} action_descriptor_t;
+
+typedef struct {
+  unsigned int address;
+  unsigned int map_mode;
+  unsigned char data[PAGE_SIZE];
+} page_t;
+
+static const char* input_name;
+
+static unsigned char* file;
+static size_t file_size;
+
+static lily_image_segment_t segments[MAX_SEGMENTS];
+static size_t segment_count;
+
+static page_t* pages[MAX_PAGES];
+static size_t page_count;
+
+static lily_image_action_t* actions;
+static size_t action_count;
+
+static char* strings;
+static size_t string_size;
+
+static void
+die (const char* message)
+{
+  fprintf (stderr, "%s: %s\n", input_name, message);
+  exit (EXIT_FAILURE);
+}
+
+static const void*
+file_at (size_t offset,
+	 size_t size)
+{
+  if (offset > file_size || size > file_size - offset) {
+    die ("truncated file");
+  }
+  return file + offset;
+}
+
+static size_t
+align_up (size_t value,
+	  size_t radix)
+{
+  return (value + radix - 1) & ~(radix - 1);
+}
+
+/* Find or create the page containing an address. */
+static page_t*
+find_page (unsigned int address)
+{
+  for (size_t idx = 0; idx != page_count; ++idx) {
+    if (pages[idx]->address == address) {
+      return pages[idx];
+    }
+  }
+
+  if (page_count == MAX_PAGES) {
+    die ("too many pages");
+  }
+
+  page_t* page = calloc (1, sizeof (page_t));
+  if (page == 0) {
+    die ("out of memory");
+  }
+  page->address = address;
+  page->map_mode = LILY_IMAGE_READ_ONLY;
+  pages[page_count++] = page;
+  return page;
+}
+
+static void
+load_segment (const Elf32_Phdr* ph)
+{
+  if (ph->p_memsz == 0) {
+    return;
+  }
+  if (ph->p_filesz > ph->p_memsz) {
+    die ("segment has extra data");
+  }
+  if (segment_count == MAX_SEGMENTS) {
+    die ("too many segments");
+  }
+
+  /* Executable segments are read-only.  Writable segments are copy-on-write. */
+  const unsigned int map_mode = ((ph->p_flags & PF_X) == 0 && (ph->p_flags & PF_W) != 0) ? LILY_IMAGE_COPY_ON_WRITE : LILY_IMAGE_READ_ONLY;
+  const unsigned char* data = file_at (ph->p_offset, ph->p_filesz);
+
+  lily_image_segment_t* s = &segments[segment_count++];
+  s->begin = ph->p_vaddr;
+  s->end = ph->p_vaddr + ph->p_memsz;
+
+  /* Copy the initialized data.  Uninitialized data is already zero. */
+  for (unsigned int address = ph->p_vaddr & ~(PAGE_SIZE - 1); address < s->end; address += PAGE_SIZE) {
+    page_t* page = find_page (address);
+    if (map_mode == LILY_IMAGE_COPY_ON_WRITE) {
+      page->map_mode = LILY_IMAGE_COPY_ON_WRITE;
+    }
+
+    const unsigned int file_end = ph->p_vaddr + ph->p_filesz;
+    const unsigned int begin = address > ph->p_vaddr ? address : ph->p_vaddr;
+    const unsigned int end = address + PAGE_SIZE < file_end ? address + PAGE_SIZE : file_end;
+    if (begin < end) {
+      memcpy (page->data + (begin - address), data + (begin - ph->p_vaddr), end - begin);
+    }
+  }
+}
+
+/* Intern a string and return its offset in the string table. */
+static unsigned int
+intern (const char* str,
+	size_t size)
+{
+  for (size_t offset = 0; offset < string_size; offset += strlen (strings + offset) + 1) {
+    if (strlen (strings + offset) + 1 == size && memcmp (strings + offset, str, size) == 0) {
+      return offset;
+    }
+  }
+
+  strings = realloc (strings, string_size + size);
+  if (strings == 0) {
+    die ("out of memory");
+  }
+  memcpy (strings + string_size, str, size);
+  string_size += size;
+  return string_size - size;
+}
+
+static void
+load_notes (const Elf32_Phdr* ph)
+{
+  const unsigned char* data = file_at (ph->p_offset, ph->p_filesz);
+  size_t pos = 0;
+  while (pos + sizeof (Elf32_Nhdr) <= ph->p_filesz) {
+    const Elf32_Nhdr* n = (const Elf32_Nhdr*)(data + pos);
+    pos += sizeof (Elf32_Nhdr);
+    const char* name = (const char*)(data + pos);
+    pos += align_up (n->n_namesz, 4);
+    const unsigned char* desc = data + pos;
+    pos += align_up (n->n_descsz, 4);
+    if (pos > ph->p_filesz || n->n_namesz == 0 || name[n->n_namesz - 1] != 0) {
+      die ("corrupt note");
+    }
+
+    if (strcmp (name, "lily") != 0) {
+      continue;
+    }
+    if (n->n_type != 0 || n->n_descsz < sizeof (action_descriptor_t)) {
+      die ("unknown note");
+    }
+
+    const action_descriptor_t* d = (const action_descriptor_t*)desc;
+    if (d->action_name_size == 0 || d->action_description_size == 0 || sizeof (action_descriptor_t) + d->action_name_size + d->action_description_size > n->n_descsz) {
+      die ("corrupt action descriptor");
+    }
+    const char* action_name = (const char*)(d + 1);
+    const char* action_description = action_name + d->action_name_size;
+    if (action_name[d->action_name_size - 1] != 0 || action_description[d->action_description_size - 1] != 0) {
+      die ("action strings are not null terminated");
+    }
+
+    actions = realloc (actions, (action_count + 1) * sizeof (lily_image_action_t));
+    if (actions == 0) {
+      die ("out of memory");
+    }
+    lily_image_action_t* a = &actions[action_count++];
+    a->type = d->action_type;
+    a->parameter_mode = d->parameter_mode;
+    a->entry_point = d->action_entry_point;
+    a->number = d->action_number;
+    a->name_offset = intern (action_name, d->action_name_size);
+    a->name_size = d->action_name_size;
+    a->description_offset = intern (action_description, d->action_description_size);
+    a->description_size = d->action_description_size;
+  }
+}
+
+static void
+write_or_die (const void* ptr,
+	      size_t size,
+	      FILE* out,
+	      const char* filename)
+{
+  if (fwrite (ptr, 1, size, out) != size) {
+    fprintf (stderr, "Could not write to %s: %s\n", filename, strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+}
+
+int
+main (int argc,
+      char** argv)
+{
+  if (argc != 3) {
+    fprintf (stderr, "Usage: %s INPUT OUTPUT\n", argv[0]);
+    exit (EXIT_FAILURE);
+  }
+
+  input_name = argv[1];
+  FILE* in = fopen (argv[1], "rb");
+  if (in == 0) {
+    fprintf (stderr, "Could not open %s: %s\n", argv[1], strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+  if (fseek (in, 0, SEEK_END) != 0) {
+    fprintf (stderr, "Could not seek in %s: %s\n", argv[1], strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+  file_size = ftell (in);
+  rewind (in);
+  file = malloc (file_size);
+  if (file == 0 || fread (file, 1, file_size, in) != file_size) {
+    die ("could not read");
+  }
+  fclose (in);
+
+  const Elf32_Ehdr* eh = file_at (0, sizeof (Elf32_Ehdr));
+  if (memcmp (eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+      eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+      eh->e_ident[EI_DATA] != ELFDATA2LSB ||
+      eh->e_type != ET_EXEC ||
+      eh->e_machine != EM_386 ||
+      eh->e_phentsize != sizeof (Elf32_Phdr)) {
+    die ("not a 32-bit x86 executable");
+  }
+
+  const Elf32_Phdr* ph = file_at (eh->e_phoff, eh->e_phnum * sizeof (Elf32_Phdr));
+  for (size_t idx = 0; idx != eh->e_phnum; ++idx) {
+    switch (ph[idx].p_type) {
+    case PT_LOAD:
+      load_segment (&ph[idx]);
+      break;
+    case PT_NOTE:
+      load_notes (&ph[idx]);
+      break;
+    }
+  }
+
+  /* Assign data pages in order.  Pages that are entirely zero map the zero frame. */
+  static const unsigned char zero[PAGE_SIZE];
+  static unsigned int data_pages[MAX_PAGES];
+  size_t data_page_count = 0;
+  for (size_t idx = 0; idx != page_count; ++idx) {
+    data_pages[idx] = memcmp (pages[idx]->data, zero, PAGE_SIZE) == 0 ? LILY_IMAGE_ZERO_PAGE : data_page_count++;
+  }
+
+  /* Each segment has an entry in the page table for each of its pages. */
+  size_t entry_count = 0;
+  for (size_t s = 0; s != segment_count; ++s) {
+    segments[s].first_page = entry_count;
+    for (unsigned int address = segments[s].begin & ~(PAGE_SIZE - 1); address < segments[s].end; address += PAGE_SIZE) {
+      ++entry_count;
+    }
+  }
+  lily_image_page_t* page_table = calloc (entry_count + 1, sizeof (lily_image_page_t));
+  if (page_table == 0) {
+    die ("out of memory");
+  }
+
+  for (size_t s = 0; s != segment_count; ++s) {
+    size_t entry = segments[s].first_page;
+    for (unsigned int address = segments[s].begin & ~(PAGE_SIZE - 1); address < segments[s].end; address += PAGE_SIZE) {
+      for (size_t idx = 0; idx != page_count; ++idx) {
+	if (pages[idx]->address == address) {
+	  page_table[entry].data_page = data_pages[idx];
+	  page_table[entry].map_mode = pages[idx]->map_mode;
+	  break;
+	}
+      }
+      ++entry;
+    }
+  }
+
+  lily_image_header_t header;
+  memcpy (header.magic, LILY_IMAGE_MAGIC, 4);
+  header.version = LILY_IMAGE_VERSION;
+  header.segment_count = segment_count;
+  header.page_count = entry_count;
+  header.action_count = action_count;
+  header.string_size = string_size;
+  const size_t tables_size = sizeof (header) + segment_count * sizeof (lily_image_segment_t) + entry_count * sizeof (lily_image_page_t) + action_count * sizeof (lily_image_action_t) + string_size;
+  header.data_offset = align_up (tables_size, PAGE_SIZE);
+
+  FILE* out = fopen (argv[2], "wb");
+  if (out == 0) {
+    fprintf (stderr, "Could not open %s: %s\n", argv[2], strerror (errno));
+    exit (EXIT_FAILURE);
+  }
+
+  write_or_die (&header, sizeof (header), out, argv[2]);
+  write_or_die (segments, segment_count * sizeof (lily_image_segment_t), out, argv[2]);
+  write_or_die (page_table, entry_count * sizeof (lily_image_page_t), out, argv[2]);
+  write_or_die (actions, action_count * sizeof (lily_image_action_t), out, argv[2]);
+  write_or_die (strings, string_size, out, argv[2]);
+  write_or_die (zero, header.data_offset - tables_size, out, argv[2]);
+  for (size_t idx = 0; idx != page_count; ++idx) {
+    if (data_pages[idx] != LILY_IMAGE_ZERO_PAGE) {
+      write_or_die (pages[idx]->data, PAGE_SIZE, out, argv[2]);
+    }
+  }
+
+  fclose (out);
+
+  exit (EXIT_SUCCESS);
+}
@@ -3,6 +3,8 @@
 #include <string.h>
 #include "buffer_file.h"
 
+#define PROFILE_BUFFER_SIZE 128
+
 struct action {
   int type;
   int parameter_mode;
@@ -318,6 +320,8 @@ system_init (system_t* system)
   system->bindq_tail = &system->bindq_head;
   system->initq_head = 0;
   system->initq_tail = &system->initq_head;
+  system->profile_time.seconds = 0;
+  system->profile_time.nanoseconds = 0;
   system->this = automaton_create (system);
   automaton_set_aid (system->this, getaid (), LILY_ERROR_SUCCESS);
 
@@ -399,13 +403,28 @@ push_init (system_t* system,
   system->initq_tail = &i->next;
 }
 
+/* Returns a pointer to the link that refers to the init item of an automaton or 0. */
+static init_item_t**
+find_init (system_t* system,
+	   aid_t aid)
+{
+  for (init_item_t** ptr = &system->initq_head; *ptr != 0; ptr = &(*ptr)->next) {
+    if ((*ptr)->automaton->aid == aid) {
+      return ptr;
+    }
+  }
+
+  return 0;
+}
+
 static void
-pop_init (system_t* system)
+erase_init (system_t* system,
+	    init_item_t** ptr)
 {
-  init_item_t* i = system->initq_head;
-  system->initq_head = i->next;
-  if (system->initq_head == 0) {
-    system->initq_tail = &system->initq_head;
+  init_item_t* i = *ptr;
+  *ptr = i->next;
+  if (*ptr == 0) {
+    system->initq_tail = ptr;
   }
 
   buffer_destroy (i->bda);
@@ -853,7 +872,10 @@ system_system_action_precondition (const system_t* system)
 void
 system_system_action (system_t* system)
 {
-  if (system->createq_head != 0) {
+  /* A callback may create an automaton that depends on the one it was given, e.g., one that needs its aid.
+     Create it in this action instead of waiting for the next one.
+     All creates are done before the binds so the binds see the aids of their automata. */
+  while (system->createq_head != 0) {
     create_item_t* ci = system->createq_head;
 
     system->createq_head = 0;
@@ -880,6 +902,9 @@ system_system_action (system_t* system)
 	  a->error = LILY_ERROR_INVAL;
 	}
       }
+      else {
+	a->error = lily_error;
+      }
       
       if (ci->callback != 0) {
 	ci->callback (ci->arg, a);
@@ -921,32 +946,30 @@ system_system_action (system_t* system)
   finish_internal ();
 }
 
-static bool
-system_init_out_precondition (const system_t* system)
-{
-  return system->initq_head != 0;
-}
-
+/* Automata in the init queue do not depend on each other.
+   Each one is initialized as soon as possible instead of waiting for the automata ahead of it in the queue. */
 void
 system_init_out (system_t* system,
 		 aid_t aid)
 {
-  if (system_init_out_precondition (system) && system->initq_head->automaton->aid == aid) {
+  init_item_t** ptr = find_init (system, aid);
+  if (ptr != 0) {
+    init_item_t* i = *ptr;
     bd_t bda = -1;
-    size_t bda_size = buffer_size (system->initq_head->bda);
+    size_t bda_size = buffer_size (i->bda);
     if (bda_size != -1) {
       bda = system->init_bda;
-      buffer_assign (bda, system->initq_head->bda, 0, bda_size);
+      buffer_assign (bda, i->bda, 0, bda_size);
     }
 
     bd_t bdb = -1;
-    size_t bdb_size = buffer_size (system->initq_head->bdb);
+    size_t bdb_size = buffer_size (i->bdb);
     if (bdb_size != -1) {
       bdb = system->init_bdb;
-      buffer_assign (bdb, system->initq_head->bdb, 0, bdb_size);
+      buffer_assign (bdb, i->bdb, 0, bdb_size);
     }
 
-    pop_init (system);
+    erase_init (system, ptr);
     finish_output (true, bda, bdb);
   }
 
@@ -959,7 +982,24 @@ system_schedule (const system_t* system)
   if (system_system_action_precondition (system)) {
     schedule (system->system_action, 0);
   }
-  if (system_init_out_precondition (system)) {
-    schedule (system->init_out, system->initq_head->automaton->aid);
+  for (const init_item_t* i = system->initq_head; i != 0; i = i->next) {
+    schedule (system->init_out, i->automaton->aid);
+  }
+}
+
+void
+system_profile (system_t* system,
+		const char* phase)
+{
+  mono_time_t now;
+  if (getmonotime (&now) != 0) {
+    return;
   }
+
+  const unsigned int elapsed = (now.seconds - system->profile_time.seconds) * 1000 + now.nanoseconds / 1000000 - system->profile_time.nanoseconds / 1000000;
+  system->profile_time = now;
+
+  char buffer[PROFILE_BUFFER_SIZE];
+  snprintf (buffer, PROFILE_BUFFER_SIZE, "profile: %s at %u.%03u (+%u ms)", phase, now.seconds, now.nanoseconds / 1000000, elapsed);
+  logs (buffer);
 }
@@ -41,6 +41,7 @@ typedef struct {
   /* ano_t binding_update_out; */
   bd_t init_bda;
   bd_t init_bdb;
+  mono_time_t profile_time;	/* Time of the last profile mark. */
   /* globbed_binding_t* globbed_binding_head; */
 } system_t;
 
@@ -129,5 +130,11 @@ system_init_out (system_t* system,
 void
 system_schedule (const system_t* system);
 
+/* Log the current time and the time since the last mark to profile start up.
+   The monotonic clock starts when the kernel starts scheduling so the first mark is relative to that point. */
+void
+system_profile (system_t* system,
+		const char* phase);
+
 
 #endif /* SYSTEM_H */
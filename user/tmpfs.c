@@ -45,6 +45,8 @@
   What we really want is a way to send two buffers at once:  one for the control message and one for the data.
   Since this pattern seems generally applicable, I decided to change the kernel to pass two buffers instead of one when executing a output/input binding.
   Thus, tmpfs and all other automata that move bulk data without processing it can be simplified.
+  The kernel now generalizes this to a list of page ranges (finish_output_list) so that framing layers can send a header, an index, and a payload without appending them into one buffer.
+  The first two buffers in the list are still delivered as bda and bdb.
   
   Implementation Details
   ----------------------